@@ -8,173 +8,6002 @@
 #include <algorithm>
 #include <future>
 #include <chrono>
+#include <thread>
+#include <functional>
+#include <memory>
+#include <map>
+#include <tuple>
+#include <cstdint>
+#include <streambuf>
+#include <deque>
+#include <condition_variable>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <charconv>
+#include <string_view>
+#include <optional>
+#include <limits>
+#include <array>
+#include <sstream>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <csignal>
+#include <unistd.h>
+
+// Side of the book an order rests on
+enum class Side : std::uint8_t { Buy, Sell };
+
+// Identifier a feed assigns to an individual resting order
+using OrderId = std::uint64_t;
+constexpr OrderId kNoOrderId = 0;
 
 template <typename K, typename V>
 struct Order {
-    std::atomic<V>* lotSize;  // Use a pointer for atomic lotSize
+    V lotSize;
+    int price;
+    Side side;
+    OrderId id;  // kNoOrderId for anonymous lot that cannot be cancelled
+
+    // Default constructor
+    Order() : lotSize(0), price(0), side(Side::Buy), id(kNoOrderId) {}
+
+    // Constructor with parameters; orders without a side are bids
+    Order(V lotSize, int price, Side side = Side::Buy)
+        : lotSize(lotSize), price(price), side(side), id(kNoOrderId) {}
+
+    // Individually identified order
+    Order(OrderId id, V lotSize, int price, Side side)
+        : lotSize(lotSize), price(price), side(side), id(id) {}
+};
+
+// Aggregated lot at one price inside a book. The lot counter lives inline
+// next to the price so a level is a single flat, cache-friendly record.
+template <typename V>
+struct PriceLevel {
+    int price;
+    std::atomic<V> lotSize;
+
+    PriceLevel() : price(0), lotSize(V()) {}
+
+    PriceLevel(int price, V lotSize) : price(price), lotSize(lotSize) {}
+};
+
+// Slab arena for small fixed-size blocks such as price-level tree nodes.
+// Every thread carves blocks from its own slab and keeps its own free lists
+// per size class, so allocation and free take no lock; only fetching a new
+// slab touches the shared slab list. releaseAll() hands back every slab at
+// once, in time independent of how many blocks were handed out, after which
+// all previously returned blocks are invalid.
+class SlabArena {
+public:
+    static constexpr std::size_t kGranularity = 16;
+    static constexpr std::size_t kMaxBlock = 256;
+
+    explicit SlabArena(std::size_t slabBytes = std::size_t(1) << 20)
+        : slabBytes_(std::max(slabBytes, kMaxBlock)),
+          serial_(nextSerial().fetch_add(1) + 1),
+          slot_(acquireSlot()) {}
+
+    SlabArena(const SlabArena& other) = delete;
+    SlabArena& operator=(const SlabArena& other) = delete;
+
+    ~SlabArena() {
+        for (char* slab : slabs_) {
+            ::operator delete(slab);
+        }
+        releaseSlot(slot_);
+    }
+
+    // Blocks larger than kMaxBlock fall through to the global heap
+    void* allocate(std::size_t bytes) {
+        if (bytes > kMaxBlock) {
+            return ::operator new(bytes);
+        }
+        const std::size_t sizeClass = (bytes + kGranularity - 1) / kGranularity;
+        ThreadPool& pool = localPool();
+        if (FreeBlock* block = pool.free[sizeClass]) {
+            pool.free[sizeClass] = block->next;
+            return block;
+        }
+        const std::size_t size = sizeClass * kGranularity;
+        if (pool.cursor == nullptr || pool.cursor + size > pool.limit) {
+            refill(pool);
+        }
+        void* block = pool.cursor;
+        pool.cursor += size;
+        return block;
+    }
+
+    // A block freed on another thread joins that thread's free list
+    void deallocate(void* pointer, std::size_t bytes) {
+        if (bytes > kMaxBlock) {
+            ::operator delete(pointer);
+            return;
+        }
+        const std::size_t sizeClass = (bytes + kGranularity - 1) / kGranularity;
+        ThreadPool& pool = localPool();
+        FreeBlock* block = static_cast<FreeBlock*>(pointer);
+        block->next = pool.free[sizeClass];
+        pool.free[sizeClass] = block;
+    }
+
+    // Free every slab at once. No thread may use the arena concurrently, and
+    // every container that allocated from it must already have been abandoned.
+    void releaseAll() {
+        std::lock_guard<std::mutex> lock(slabsMutex_);
+        for (char* slab : slabs_) {
+            ::operator delete(slab);
+        }
+        slabs_.clear();
+        generation_.fetch_add(1, std::memory_order_release);
+    }
+
+    std::size_t slabCount() const {
+        std::lock_guard<std::mutex> lock(slabsMutex_);
+        return slabs_.size();
+    }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    // One thread's view of the arena; reset whenever releaseAll() ran since
+    // or the slot now belongs to another arena
+    struct ThreadPool {
+        std::uint64_t serial = 0;
+        std::uint64_t generation = 0;
+        FreeBlock* free[kMaxBlock / kGranularity + 1] = {};
+        char* cursor = nullptr;
+        char* limit = nullptr;
+    };
+
+    // Small indexes into each thread's pool table, reused once their arena
+    // is destroyed, so the tables grow with the most arenas alive at once
+    // rather than with every arena ever created
+    struct SlotRegistry {
+        std::mutex mutex;
+        std::vector<std::size_t> free;
+        std::size_t next = 0;
+    };
+
+    static std::atomic<std::uint64_t>& nextSerial() {
+        static std::atomic<std::uint64_t> serial{0};
+        return serial;
+    }
+
+    static SlotRegistry& slotRegistry() {
+        static SlotRegistry registry;
+        return registry;
+    }
+
+    static std::size_t acquireSlot() {
+        SlotRegistry& registry = slotRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        if (registry.free.empty()) {
+            return registry.next++;
+        }
+        const std::size_t slot = registry.free.back();
+        registry.free.pop_back();
+        return slot;
+    }
+
+    static void releaseSlot(std::size_t slot) {
+        SlotRegistry& registry = slotRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.free.push_back(slot);
+    }
+
+    ThreadPool& localPool() {
+        // A reused slot may still hold a destroyed arena's pool; the serial,
+        // which is never reused, tells them apart
+        thread_local std::vector<ThreadPool> pools;
+        if (slot_ >= pools.size()) {
+            pools.resize(slot_ + 1);
+        }
+        ThreadPool& pool = pools[slot_];
+        const std::uint64_t generation = generation_.load(std::memory_order_acquire);
+        if (pool.serial != serial_ || pool.generation != generation) {
+            pool = ThreadPool();
+            pool.serial = serial_;
+            pool.generation = generation;
+        }
+        return pool;
+    }
+
+    void refill(ThreadPool& pool) {
+        char* slab = static_cast<char*>(::operator new(slabBytes_));
+        {
+            std::lock_guard<std::mutex> lock(slabsMutex_);
+            slabs_.push_back(slab);
+        }
+        pool.cursor = slab;
+        pool.limit = slab + slabBytes_;
+    }
+
+    const std::size_t slabBytes_;
+    const std::uint64_t serial_;
+    const std::size_t slot_;
+    std::atomic<std::uint64_t> generation_{1};
+    mutable std::mutex slabsMutex_;
+    std::vector<char*> slabs_;
+};
+
+// Standard allocator drawing from a SlabArena. A default-constructed
+// allocator has no arena and uses the global heap.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template <typename U>
+    struct rebind {
+        using other = ArenaAllocator<U>;
+    };
+
+    ArenaAllocator() noexcept = default;
+
+    explicit ArenaAllocator(SlabArena& arena) noexcept : arena_(&arena) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena_(other.arena()) {}
+
+    T* allocate(std::size_t count) {
+        const std::size_t bytes = count * sizeof(T);
+        return static_cast<T*>(arena_ != nullptr ? arena_->allocate(bytes) : ::operator new(bytes));
+    }
+
+    void deallocate(T* pointer, std::size_t count) noexcept {
+        if (arena_ != nullptr) {
+            arena_->deallocate(pointer, count * sizeof(T));
+        } else {
+            ::operator delete(pointer);
+        }
+    }
+
+    SlabArena* arena() const noexcept {
+        return arena_;
+    }
+
+    // Memory is reclaimed by SlabArena::releaseAll rather than per block,
+    // unless there is no arena and blocks come from the global heap
+    bool releasesWholesale() const noexcept {
+        return arena_ != nullptr;
+    }
+
+private:
+    SlabArena* arena_ = nullptr;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) noexcept {
+    return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) noexcept {
+    return !(a == b);
+}
+
+// True for allocators that can say whether their memory is reclaimed
+// wholesale; whether it is may depend on the allocator's state
+template <typename Alloc, typename = void>
+struct HasWholesaleRelease : std::false_type {};
+
+template <typename Alloc>
+struct HasWholesaleRelease<Alloc, std::void_t<decltype(std::declval<const Alloc&>().releasesWholesale())>>
+    : std::true_type {};
+
+// True if alloc's memory is reclaimed wholesale, which lets books be
+// dropped without visiting every level
+template <typename Alloc>
+bool releasesWholesale(const Alloc& alloc) {
+    if constexpr (HasWholesaleRelease<Alloc>::value) {
+        return alloc.releasesWholesale();
+    } else {
+        return false;
+    }
+}
+
+// Index of the lowest / highest set bit of a non-zero word
+inline int lowestSetBit(std::uint64_t word) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
+    while ((word & 1) == 0) {
+        word >>= 1;
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+inline int highestSetBit(std::uint64_t word) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(word);
+#else
+    int bit = 63;
+    while ((word & (std::uint64_t(1) << bit)) == 0) {
+        --bit;
+    }
+    return bit;
+#endif
+}
+
+// Price levels of one book kept sorted by price, giving O(log n) lookup of a
+// level and O(1) access to the lowest and highest levels. Levels are built in
+// place and never move while they stay in the same store. A level that is
+// reduced to nothing is unlinked, and its tree node is kept for the next
+// level the ladder opens rather than handed back to the allocator.
+//
+// By default levels live in a tree whose nodes come from Alloc. A ladder can
+// instead be switched to tick-indexed storage: prices on the tick grid inside
+// a window around the reference price are held in a direct-indexed array
+// with a two-level occupancy bitmap, so insert is a direct index and the
+// best levels are a find-first/last-set. Off-grid and out-of-window prices
+// fall back to the tree. Once on-grid levels outside the window outnumber
+// those inside, the window recentres if that brings more levels into it.
+template <typename V, typename Alloc = std::allocator<char>>
+class PriceLadder {
+    using Entry = std::pair<const int, PriceLevel<V>>;
+    using Tree = std::map<int, PriceLevel<V>, std::less<int>,
+                          typename std::allocator_traits<Alloc>::template rebind_alloc<Entry>>;
+
+public:
+    // Largest window the two-level bitmap can index
+    static constexpr std::size_t kMaxWindowTicks = 64 * 64;
+
+    PriceLadder() = default;
+
+    // Switch an empty ladder to allocate from alloc
+    void useAllocator(const Alloc& alloc) {
+        tree_ = Tree(std::less<int>(), typename Tree::allocator_type(alloc));
+    }
+
+    // Switch to tick-indexed storage with a window of windowTicks slots on the
+    // grid through referencePrice, centred on it. Existing levels are kept.
+    void useTickWindow(int referencePrice, int tickSize, std::size_t windowTicks) {
+        const std::vector<std::pair<int, V>> levels = drain();
+        windowTicks = std::min(std::max<std::size_t>(windowTicks, 64), kMaxWindowTicks);
+        window_ = std::make_unique<TickWindow>((windowTicks + 63) / 64);
+        tick_ = tickSize > 0 ? tickSize : 1;
+        reference_ = referencePrice;
+        centreOn(referencePrice);
+        for (const auto& level : levels) {
+            place(level.first, level.second);
+        }
+    }
+
+    bool tickIndexed() const {
+        return window_ != nullptr;
+    }
+
+    // Number of levels held in the tick window rather than the tree
+    std::size_t windowDepth() const {
+        return window_ == nullptr ? 0 : window_->count;
+    }
+
+    // Add lot at price, creating the level if it does not exist yet
+    void add(int price, V lot) {
+        if (window_ != nullptr) {
+            if (window_->count == 0 && tree_.empty()) {
+                centreOn(price);
+            }
+            const long slot = slotOf(price);
+            if (slot >= 0) {
+                addToWindow(static_cast<std::size_t>(slot), price, lot);
+                return;
+            }
+        }
+        // Only a new on-grid level can change what a recentre would gain;
+        // off-grid levels never fit the window wherever it is
+        if (addToTree(price, lot) && window_ != nullptr && onGrid(price) &&
+            outliers_ >= recentreAt_ && outliers_ > window_->count) {
+            recentre(price);
+        }
+    }
+
+    // Take up to lot off the level at price, unlinking the level once it is
+    // empty. Sets taken to the lot actually removed; returns false if there
+    // is no level at price.
+    bool reduce(int price, V lot, V& taken) {
+        taken = V();
+        if (window_ != nullptr) {
+            const long slot = slotOf(price);
+            if (slot >= 0) {
+                if (!window_->occupied(static_cast<std::size_t>(slot))) {
+                    return false;
+                }
+                if (takeFrom(window_->levels[slot], lot, taken)) {
+                    window_->unmark(static_cast<std::size_t>(slot));
+                }
+                return true;
+            }
+        }
+        auto it = tree_.find(price);
+        if (it == tree_.end()) {
+            return false;
+        }
+        if (takeFrom(it->second, lot, taken)) {
+            if (window_ != nullptr && onGrid(price)) {
+                --outliers_;
+            }
+            if (spare_.size() < kMaxSpareNodes) {
+                spare_.push_back(tree_.extract(it));
+            } else {
+                tree_.erase(it);
+            }
+        }
+        return true;
+    }
+
+    // Find the level at price, or nullptr if there is none
+    const PriceLevel<V>* find(int price) const {
+        if (window_ != nullptr) {
+            const long slot = slotOf(price);
+            if (slot >= 0) {
+                return window_->occupied(static_cast<std::size_t>(slot)) ? &window_->levels[slot] : nullptr;
+            }
+        }
+        auto it = tree_.find(price);
+        return it == tree_.end() ? nullptr : &it->second;
+    }
+
+    bool empty() const {
+        return depth() == 0;
+    }
+
+    std::size_t depth() const {
+        return tree_.size() + windowDepth();
+    }
+
+    // Lowest and highest levels; the ladder must not be empty
+    const PriceLevel<V>& lowest() const {
+        const PriceLevel<V>* best = window_ == nullptr ? nullptr : window_->first();
+        if (!tree_.empty() && (best == nullptr || tree_.begin()->first < best->price)) {
+            return tree_.begin()->second;
+        }
+        return *best;
+    }
+
+    const PriceLevel<V>& highest() const {
+        const PriceLevel<V>* best = window_ == nullptr ? nullptr : window_->last();
+        if (!tree_.empty() && (best == nullptr || tree_.rbegin()->first > best->price)) {
+            return tree_.rbegin()->second;
+        }
+        return *best;
+    }
+
+    void clear() {
+        tree_.clear();
+        if (window_ != nullptr) {
+            window_->clear();
+        }
+        outliers_ = 0;
+        recentreAt_ = kRecentreThreshold;
+    }
+
+    // True if levels may be abandoned rather than freed
+    bool releasesWholesale() const {
+        return ::releasesWholesale(tree_.get_allocator());
+    }
+
+    // Forget every level without freeing them one by one. Only valid when
+    // releasesWholesale() holds, as it does for an arena-backed allocator.
+    void abandon() {
+        spare_.clear();
+        const auto alloc = tree_.get_allocator();
+        new (&tree_) Tree(std::less<int>(), alloc);
+        if (window_ != nullptr) {
+            window_->clear();
+        }
+        outliers_ = 0;
+        recentreAt_ = kRecentreThreshold;
+    }
+
+    // Visit levels in ascending price order, merging window and tree
+    template <typename F>
+    void forEach(F&& fn) const {
+        auto it = tree_.begin();
+        if (window_ != nullptr) {
+            window_->forEach([&](const PriceLevel<V>& level) {
+                for (; it != tree_.end() && it->first < level.price; ++it) {
+                    fn(it->second);
+                }
+                fn(level);
+            });
+        }
+        for (; it != tree_.end(); ++it) {
+            fn(it->second);
+        }
+    }
+
+private:
+    // Outliers tolerated in the tree before the window is moved
+    static constexpr std::size_t kRecentreThreshold = 8;
+
+    // Unlinked tree nodes kept for reuse
+    static constexpr std::size_t kMaxSpareNodes = 64;
+
+    // Direct-indexed levels with one occupancy bit per slot and one summary
+    // bit per non-empty bitmap word
+    struct TickWindow {
+        explicit TickWindow(std::size_t wordCount)
+            : levels(new PriceLevel<V>[wordCount * 64]), words(wordCount, 0) {}
+
+        bool occupied(std::size_t slot) const {
+            return (words[slot / 64] >> (slot % 64)) & 1;
+        }
+
+        void mark(std::size_t slot) {
+            words[slot / 64] |= std::uint64_t(1) << (slot % 64);
+            summary |= std::uint64_t(1) << (slot / 64);
+            ++count;
+        }
+
+        void unmark(std::size_t slot) {
+            words[slot / 64] &= ~(std::uint64_t(1) << (slot % 64));
+            if (words[slot / 64] == 0) {
+                summary &= ~(std::uint64_t(1) << (slot / 64));
+            }
+            --count;
+        }
+
+        const PriceLevel<V>* first() const {
+            if (summary == 0) {
+                return nullptr;
+            }
+            const int word = lowestSetBit(summary);
+            return &levels[word * 64 + lowestSetBit(words[word])];
+        }
+
+        const PriceLevel<V>* last() const {
+            if (summary == 0) {
+                return nullptr;
+            }
+            const int word = highestSetBit(summary);
+            return &levels[word * 64 + highestSetBit(words[word])];
+        }
+
+        template <typename F>
+        void forEach(F&& fn) const {
+            for (std::uint64_t pending = summary; pending != 0; pending &= pending - 1) {
+                const int word = lowestSetBit(pending);
+                for (std::uint64_t bits = words[word]; bits != 0; bits &= bits - 1) {
+                    fn(levels[word * 64 + lowestSetBit(bits)]);
+                }
+            }
+        }
+
+        void clear() {
+            std::fill(words.begin(), words.end(), 0);
+            summary = 0;
+            count = 0;
+        }
+
+        std::size_t size() const {
+            return words.size() * 64;
+        }
+
+        std::unique_ptr<PriceLevel<V>[]> levels;
+        std::vector<std::uint64_t> words;
+        std::uint64_t summary = 0;
+        std::size_t count = 0;
+        long base = 0;  // Price of slot 0
+    };
+
+    // Slot of price in the window, or -1 if it is off the grid or outside
+    long slotOf(int price) const {
+        const long offset = static_cast<long>(price) - window_->base;
+        if (offset < 0 || offset % tick_ != 0) {
+            return -1;
+        }
+        const long slot = offset / tick_;
+        return slot < static_cast<long>(window_->size()) ? slot : -1;
+    }
+
+    void addToWindow(std::size_t slot, int price, V lot) {
+        PriceLevel<V>& level = window_->levels[slot];
+        if (window_->occupied(slot)) {
+            level.lotSize.fetch_add(lot, std::memory_order_relaxed);
+            return;
+        }
+        level.price = price;
+        level.lotSize.store(lot, std::memory_order_relaxed);
+        window_->mark(slot);
+    }
+
+    // Returns true if a new level was created
+    bool addToTree(int price, V lot) {
+        auto it = tree_.lower_bound(price);
+        if (it != tree_.end() && it->first == price) {
+            it->second.lotSize.fetch_add(lot, std::memory_order_relaxed);
+            return false;
+        }
+        if (window_ != nullptr && onGrid(price)) {
+            ++outliers_;
+        }
+        if (!spare_.empty()) {
+            typename Tree::node_type node = std::move(spare_.back());
+            spare_.pop_back();
+            node.key() = price;
+            node.mapped().price = price;
+            node.mapped().lotSize.store(lot, std::memory_order_relaxed);
+            tree_.insert(it, std::move(node));
+            return true;
+        }
+        tree_.emplace_hint(it, std::piecewise_construct,
+                           std::forward_as_tuple(price), std::forward_as_tuple(price, lot));
+        return true;
+    }
+
+    bool onGrid(int price) const {
+        return (static_cast<long>(price) - reference_) % tick_ == 0;
+    }
+
+    // Subtract up to lot from a level; returns true once the level is empty
+    static bool takeFrom(PriceLevel<V>& level, V lot, V& taken) {
+        const V remaining = level.lotSize.load(std::memory_order_relaxed);
+        taken = lot < remaining ? lot : remaining;
+        level.lotSize.fetch_sub(taken, std::memory_order_relaxed);
+        return taken == remaining;
+    }
+
+    // Add without triggering a recentre; used while rebuilding
+    void place(int price, V lot) {
+        const long slot = slotOf(price);
+        if (slot >= 0) {
+            addToWindow(static_cast<std::size_t>(slot), price, lot);
+        } else {
+            addToTree(price, lot);
+        }
+    }
+
+    // Put the window's middle slot on the grid price nearest at or below centre
+    void centreOn(int centre) {
+        window_->base = baseFor(centre);
+    }
+
+    long baseFor(int centre) const {
+        long offset = (static_cast<long>(centre) - reference_) % tick_;
+        if (offset < 0) {
+            offset += tick_;
+        }
+        return static_cast<long>(centre) - offset - static_cast<long>(window_->size() / 2) * tick_;
+    }
+
+    // Move the window to where prices now trade: the middle of the book if it
+    // fits, otherwise the latest outlier. The ladder is only rebuilt if the
+    // new window holds more levels than the current one; either way the next
+    // attempt waits until the outliers have doubled.
+    void recentre(int latestPrice) {
+        const long low = lowest().price;
+        const long span = static_cast<long>(highest().price) - low;
+        const long windowSpan = static_cast<long>(window_->size()) * tick_;
+        const long base = baseFor(span < windowSpan ? static_cast<int>(low + span / 2) : latestPrice);
+        std::size_t covered = 0;
+        forEach([&](const PriceLevel<V>& level) {
+            const long offset = static_cast<long>(level.price) - base;
+            if (offset >= 0 && offset < windowSpan && offset % tick_ == 0) {
+                ++covered;
+            }
+        });
+        if (covered > window_->count) {
+            const std::vector<std::pair<int, V>> levels = drain();
+            window_->base = base;
+            for (const auto& level : levels) {
+                place(level.first, level.second);
+            }
+        }
+        recentreAt_ = std::max(kRecentreThreshold, outliers_ * 2);
+    }
+
+    // Remove every level, returning (price, lot) pairs in ascending order
+    std::vector<std::pair<int, V>> drain() {
+        std::vector<std::pair<int, V>> levels;
+        levels.reserve(depth());
+        forEach([&levels](const PriceLevel<V>& level) {
+            levels.emplace_back(level.price, level.lotSize.load(std::memory_order_relaxed));
+        });
+        clear();
+        return levels;
+    }
+
+    Tree tree_;
+    std::vector<typename Tree::node_type> spare_;
+    std::unique_ptr<TickWindow> window_;
+    int tick_ = 1;
+    int reference_ = 0;
+    std::size_t outliers_ = 0;  // On-grid levels held in the tree
+    std::size_t recentreAt_ = kRecentreThreshold;
+};
+
+// Dense integer handle for an interned symbol
+using SymbolId = std::uint32_t;
+
+constexpr SymbolId kInvalidSymbol = 0xFFFFFFFFu;
+
+// Lock-free open-addressing table interning symbols to dense SymbolIds.
+// Slots are claimed with a CAS on an empty slot and are never released, so
+// lookups of existing symbols never block. The CAS winner draws the next id,
+// which keeps ids dense in [0, capacity) for use as direct array indexes.
+template <typename K>
+class SymbolTable {
+public:
+    // Slots are over-provisioned to twice the symbol capacity to keep probes short
+    explicit SymbolTable(std::size_t capacity) : capacity_(capacity) {
+        std::size_t size = 16;
+        while (size < capacity * 2) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        slots_.reset(new std::atomic<Entry*>[size]);
+        for (std::size_t i = 0; i < size; ++i) {
+            slots_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    SymbolTable(const SymbolTable& other) = delete;
+    SymbolTable& operator=(const SymbolTable& other) = delete;
+
+    ~SymbolTable() {
+        for (std::size_t i = 0; i <= mask_; ++i) {
+            delete slots_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Maximum number of symbols that can be interned
+    std::size_t capacity() const {
+        return capacity_;
+    }
+
+    // Number of ids handed out so far
+    std::size_t size() const {
+        return std::min<std::size_t>(nextId_.load(std::memory_order_acquire), capacity_);
+    }
+
+    // Find the id of a symbol, or kInvalidSymbol if it was never interned
+    SymbolId find(const K& key, std::size_t hash) const {
+        for (std::size_t probe = 0; probe <= mask_; ++probe) {
+            Entry* entry = slots_[(hash + probe) & mask_].load(std::memory_order_acquire);
+            if (entry == nullptr) {
+                return kInvalidSymbol;
+            }
+            if (entry->hash == hash && entry->key == key) {
+                return entry->awaitId();
+            }
+        }
+        return kInvalidSymbol;
+    }
+
+    // Find the id of a symbol, interning it if needed. onCreate(id) runs once,
+    // in the thread that claimed the slot, before the id becomes visible to
+    // anyone else. Returns kInvalidSymbol when the table is full.
+    template <typename F>
+    SymbolId intern(const K& key, std::size_t hash, F&& onCreate) {
+        Entry* created = nullptr;
+        for (std::size_t probe = 0; probe <= mask_; ++probe) {
+            std::atomic<Entry*>& slot = slots_[(hash + probe) & mask_];
+            Entry* entry = slot.load(std::memory_order_acquire);
+            if (entry == nullptr) {
+                if (created == nullptr) {
+                    created = new Entry(key, hash);
+                }
+                if (slot.compare_exchange_strong(entry, created, std::memory_order_acq_rel,
+                                                 std::memory_order_acquire)) {
+                    SymbolId id = nextId_.fetch_add(1, std::memory_order_relaxed);
+                    if (id >= capacity_) {
+                        id = kInvalidSymbol;
+                    } else {
+                        onCreate(id);
+                    }
+                    created->id.store(id, std::memory_order_release);
+                    return id;
+                }
+                // Lost the race; entry now holds the winner, which may be our symbol
+            }
+            if (entry->hash == hash && entry->key == key) {
+                delete created;
+                return entry->awaitId();
+            }
+        }
+        delete created;
+        return kInvalidSymbol;
+    }
+
+private:
+    // Marks a slot whose winner has not yet published its id
+    static constexpr SymbolId kPendingSymbol = kInvalidSymbol - 1;
+
+    struct Entry {
+        Entry(const K& key, std::size_t hash) : key(key), hash(hash) {}
+
+        // A claimed slot is only unpublished for the few instructions between
+        // the CAS and the id store, so waiting here is a brief spin
+        SymbolId awaitId() const {
+            SymbolId value;
+            while ((value = id.load(std::memory_order_acquire)) == kPendingSymbol) {
+                std::this_thread::yield();
+            }
+            return value;
+        }
+
+        const K key;
+        const std::size_t hash;
+        std::atomic<SymbolId> id{kPendingSymbol};
+    };
+
+    std::unique_ptr<std::atomic<Entry*>[]> slots_;
+    std::size_t mask_ = 0;
+    const std::size_t capacity_;
+    std::atomic<SymbolId> nextId_{0};
+};
+
+// Where a resting order sits: its book, side and level, and its remaining lot
+template <typename V>
+struct OrderLocation {
+    SymbolId symbol;
+    Side side;
     int price;
+    V lot;
+    std::uint32_t generation;  // Book generation the order was placed in
+    std::uint32_t bookSlot;    // Position of the id in its book's order list
+};
+
+// Concurrent hash index from order id to its location, split into
+// independently locked stripes so cancels of unrelated orders do not contend.
+// Callers hold mutexFor(id) around find, add and erase.
+template <typename V>
+class OrderIndex {
+public:
+    explicit OrderIndex(std::size_t stripeCount = 64) : stripes_(stripeCount == 0 ? 1 : stripeCount) {}
+
+    OrderIndex(const OrderIndex& other) = delete;
+    OrderIndex& operator=(const OrderIndex& other) = delete;
+
+    std::mutex& mutexFor(OrderId id) {
+        return stripeFor(id).mutex;
+    }
+
+    // Returns false if the id is already present
+    bool add(OrderId id, const OrderLocation<V>& location) {
+        return stripeFor(id).orders.emplace(id, location).second;
+    }
+
+    OrderLocation<V>* find(OrderId id) {
+        auto& orders = stripeFor(id).orders;
+        auto it = orders.find(id);
+        return it == orders.end() ? nullptr : &it->second;
+    }
+
+    void erase(OrderId id) {
+        stripeFor(id).orders.erase(id);
+    }
+
+    // Number of indexed orders; takes every stripe lock in turn
+    std::size_t size() {
+        std::size_t total = 0;
+        for (auto& stripe : stripes_) {
+            std::lock_guard<std::mutex> lock(stripe.mutex);
+            total += stripe.orders.size();
+        }
+        return total;
+    }
+
+private:
+    struct alignas(64) Stripe {
+        std::mutex mutex;
+        std::unordered_map<OrderId, OrderLocation<V>> orders;
+    };
+
+    Stripe& stripeFor(OrderId id) {
+        return stripes_[id % stripes_.size()];
+    }
+
+    std::vector<Stripe> stripes_;
+};
+
+// Epoch-based reclamation for objects that lock-free readers may still be
+// walking after a writer has replaced them. Readers pin the current epoch for
+// the duration of a read; a retired object is freed once every reader pinned
+// at or before its retirement epoch has left.
+class EpochDomain {
+public:
+    // Pins the calling thread into the current epoch while in scope
+    class Guard {
+    public:
+        explicit Guard(EpochDomain& domain) : slot_(domain.enter()) {}
+
+        Guard(const Guard& other) = delete;
+        Guard& operator=(const Guard& other) = delete;
+
+        ~Guard() {
+            slot_->store(kIdle, std::memory_order_seq_cst);
+        }
+
+    private:
+        std::atomic<std::uint64_t>* slot_;
+    };
+
+    EpochDomain() = default;
+    EpochDomain(const EpochDomain& other) = delete;
+    EpochDomain& operator=(const EpochDomain& other) = delete;
+
+    ~EpochDomain() {
+        for (const auto& retired : retired_) {
+            retired.deleter(retired.object);
+        }
+    }
+
+    // Hand over an object that has already been unpublished; it is deleted
+    // once no pinned reader can still hold a pointer to it
+    template <typename T>
+    void retire(const T* object) {
+        const std::uint64_t epoch = epoch_.fetch_add(1, std::memory_order_seq_cst);
+        std::lock_guard<std::mutex> lock(retiredMutex_);
+        retired_.push_back({epoch, object, [](const void* p) { delete static_cast<const T*>(p); }});
+        if (retired_.size() >= kReclaimThreshold) {
+            reclaimLocked();
+        }
+    }
+
+    // Free every retired object that no reader can still see
+    void reclaim() {
+        std::lock_guard<std::mutex> lock(retiredMutex_);
+        reclaimLocked();
+    }
+
+    // Number of retired objects still waiting for readers to leave
+    std::size_t pendingCount() const {
+        std::lock_guard<std::mutex> lock(retiredMutex_);
+        return retired_.size();
+    }
+
+private:
+    static constexpr std::uint64_t kIdle = ~std::uint64_t(0);
+    static constexpr std::size_t kSlots = 64;
+    static constexpr std::size_t kReclaimThreshold = 64;
+
+    struct alignas(64) Slot {
+        std::atomic<std::uint64_t> epoch{kIdle};
+    };
+
+    struct Retired {
+        std::uint64_t epoch;
+        const void* object;
+        void (*deleter)(const void*);
+    };
+
+    // Claim a free reader slot and publish the current epoch in it
+    std::atomic<std::uint64_t>* enter() {
+        const std::size_t start = std::hash<std::thread::id>{}(std::this_thread::get_id());
+        for (std::size_t attempt = 0;; ++attempt) {
+            std::atomic<std::uint64_t>& slot = slots_[(start + attempt) % kSlots].epoch;
+            std::uint64_t idle = kIdle;
+            if (slot.load(std::memory_order_relaxed) == kIdle &&
+                slot.compare_exchange_strong(idle, epoch_.load(std::memory_order_seq_cst),
+                                             std::memory_order_seq_cst)) {
+                return &slot;
+            }
+            if (attempt % kSlots == kSlots - 1) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    void reclaimLocked() {
+        std::uint64_t oldestPinned = kIdle;
+        for (const auto& slot : slots_) {
+            oldestPinned = std::min(oldestPinned, slot.epoch.load(std::memory_order_seq_cst));
+        }
+        auto keep = std::partition(retired_.begin(), retired_.end(),
+            [oldestPinned](const Retired& retired) {
+                return retired.epoch >= oldestPinned;
+            });
+        for (auto it = keep; it != retired_.end(); ++it) {
+            it->deleter(it->object);
+        }
+        retired_.erase(keep, retired_.end());
+    }
+
+    std::atomic<std::uint64_t> epoch_{1};
+    Slot slots_[kSlots];
+    mutable std::mutex retiredMutex_;
+    std::vector<Retired> retired_;
+};
+
+// Reusable executor with one task deque per worker. A worker pops its own
+// deque newest-first and, when that is empty, steals the oldest task from
+// another worker before going to sleep. Tasks submitted from a worker stay on
+// its own deque; outside submissions are spread round-robin.
+class WorkStealingPool {
+public:
+    explicit WorkStealingPool(std::size_t workerCount = std::thread::hardware_concurrency()) {
+        workerCount = std::max<std::size_t>(1, workerCount);
+        for (std::size_t i = 0; i < workerCount; ++i) {
+            workers_.push_back(std::make_unique<Worker>());
+        }
+        for (std::size_t i = 0; i < workerCount; ++i) {
+            threads_.emplace_back([this, i]() {
+                run(i);
+            });
+        }
+    }
+
+    WorkStealingPool(const WorkStealingPool& other) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool& other) = delete;
+
+    // Finish every queued task, then stop the workers
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            stopping_ = true;
+        }
+        wake_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    std::size_t size() const {
+        return workers_.size();
+    }
+
+    // Queue fn and return a future for its result
+    template <typename F>
+    auto submit(F&& fn) -> std::future<decltype(fn())> {
+        using Result = decltype(fn());
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(fn));
+        std::future<Result> result = task->get_future();
+
+        std::size_t target;
+        if (currentPool_ == this) {
+            target = currentWorker_;
+        } else {
+            target = nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+        }
+        // Count the task before it becomes visible, so a worker that takes it
+        // at once never decrements below zero; taking sleepMutex_ also orders
+        // the count against a worker about to wait
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            ++pending_;
+        }
+        {
+            std::lock_guard<std::mutex> lock(workers_[target]->mutex);
+            workers_[target]->tasks.emplace_back([task]() {
+                (*task)();
+            });
+        }
+        wake_.notify_one();
+        return result;
+    }
+
+private:
+    struct alignas(64) Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    bool popLocal(std::size_t index, std::function<void()>& task) {
+        Worker& worker = *workers_[index];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.tasks.empty()) {
+            return false;
+        }
+        task = std::move(worker.tasks.back());
+        worker.tasks.pop_back();
+        return true;
+    }
+
+    bool steal(std::size_t thief, std::function<void()>& task) {
+        for (std::size_t offset = 1; offset < workers_.size(); ++offset) {
+            Worker& victim = *workers_[(thief + offset) % workers_.size()];
+            std::unique_lock<std::mutex> lock(victim.mutex, std::try_to_lock);
+            if (!lock.owns_lock() || victim.tasks.empty()) {
+                continue;
+            }
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+
+    void run(std::size_t index) {
+        currentPool_ = this;
+        currentWorker_ = index;
+        std::function<void()> task;
+        while (true) {
+            if (popLocal(index, task) || steal(index, task)) {
+                {
+                    std::lock_guard<std::mutex> lock(sleepMutex_);
+                    --pending_;
+                }
+                task();
+                task = nullptr;
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleepMutex_);
+            wake_.wait(lock, [this]() {
+                return pending_ > 0 || stopping_;
+            });
+            if (stopping_ && pending_ == 0) {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::vector<std::thread> threads_;
+    std::atomic<std::size_t> nextWorker_{0};
+
+    // Tasks queued but not yet taken; guarded by sleepMutex_
+    std::size_t pending_ = 0;
+    bool stopping_ = false;
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+
+    static thread_local WorkStealingPool* currentPool_;
+    static thread_local std::size_t currentWorker_;
+};
+
+thread_local WorkStealingPool* WorkStealingPool::currentPool_ = nullptr;
+thread_local std::size_t WorkStealingPool::currentWorker_ = 0;
+
+// Aggregated lot at one price as captured in a book snapshot
+template <typename V>
+struct SnapshotLevel {
+    int price;
+    V lotSize;
+};
+
+// Immutable copy of one book's levels, shared with readers under an epoch guard
+template <typename V>
+struct BookSnapshot {
+    std::uint32_t sequence = 0;  // Book seqlock value the copy was taken at
+    bool live = false;
+    std::vector<SnapshotLevel<V>> bids;  // Ascending price
+    std::vector<SnapshotLevel<V>> asks;  // Ascending price
+};
+
+// One update in an insertBatch packet: add lotSize at price on one side of an
+// interned symbol's book
+template <typename V>
+struct OrderUpdate {
+    SymbolId symbol;
+    V lotSize;
+    int price;
+    Side side = Side::Buy;
+};
+
+// One execution between an incoming order and a resting one, at the resting
+// order's price
+template <typename V>
+struct Trade {
+    SymbolId symbol;
+    OrderId aggressor;
+    OrderId resting;
+    Side aggressorSide;
+    int price;
+    V lot;
+};
+
+// Bounded single-producer single-consumer ring. The two indexes live on
+// separate cache lines and each side caches the other's index, so in the
+// common case neither side touches a line the other is writing.
+template <typename T>
+class SpscRing {
+public:
+    explicit SpscRing(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        buffer_.resize(size);
+        mask_ = size - 1;
+    }
+
+    // Producer side; returns false if the ring is full
+    bool tryPush(const T& value) {
+        const std::size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - headCache_ > mask_) {
+            headCache_ = head_.load(std::memory_order_acquire);
+            if (tail - headCache_ > mask_) {
+                return false;
+            }
+        }
+        buffer_[tail & mask_] = value;
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; returns false if the ring is empty
+    bool tryPop(T& value) {
+        const std::size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tailCache_) {
+            tailCache_ = tail_.load(std::memory_order_acquire);
+            if (head == tailCache_) {
+                return false;
+            }
+        }
+        value = buffer_[head & mask_];
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<std::size_t> head_{0};
+    std::size_t tailCache_ = 0;  // Consumer's view of tail_
+    alignas(64) std::atomic<std::size_t> tail_{0};
+    std::size_t headCache_ = 0;  // Producer's view of head_
+    alignas(64) std::vector<T> buffer_;
+    std::size_t mask_ = 0;
+};
+
+// What a Diagnostic reports; each kind has its own rate limit and counters
+enum class DiagnosticKind : std::uint8_t {
+    SymbolNotFound, SymbolTableFull, NoSuchLevel, OrderNotFound, DuplicateOrder, OrderRejected, WriteFailed,
+    InvalidLot, ShardOwned
+};
+constexpr std::size_t kDiagnosticKinds = 9;
+
+template <typename K, typename V, typename Alloc = std::allocator<char>>
+class ConcurrentHashMap;
+
+template <typename K, typename V, typename Alloc = std::allocator<char>>
+class MatchingEngine;
+
+// Shard-per-core actor mode. Each core thread owns a disjoint set of the map's
+// shards and is the only writer to their books, so it mutates them without
+// taking any lock. Producers route requests by symbol over one SPSC ring per
+// (producer, core) pair. While the actors exist, the owned books must only be
+// changed through them; the map's own mutators return Status::Rejected for
+// them, and display() sees them through snapshots that the owning core
+// republishes whenever it goes idle.
+template <typename K, typename V, typename Alloc = std::allocator<char>>
+class ShardActors {
+public:
+    ShardActors(ConcurrentHashMap<K, V, Alloc>& map, std::size_t cores, std::size_t producers,
+                std::size_t ringCapacity = 4096)
+        : map_(map),
+          cores_(std::max<std::size_t>(1, cores)),
+          producers_(std::max<std::size_t>(1, producers)),
+          enqueued_(producers_) {
+        for (std::size_t i = 0; i < producers_ * cores_; ++i) {
+            rings_.push_back(std::make_unique<SpscRing<Request>>(ringCapacity));
+        }
+        for (std::size_t core = 0; core < cores_; ++core) {
+            states_.push_back(std::make_unique<CoreState>());
+        }
+        map_.setShardsOwned(true);
+        for (std::size_t core = 0; core < cores_; ++core) {
+            threads_.emplace_back([this, core]() {
+                run(core);
+            });
+        }
+    }
+
+    ShardActors(const ShardActors& other) = delete;
+    ShardActors& operator=(const ShardActors& other) = delete;
+
+    // Apply everything already queued, then hand the shards back to the map
+    ~ShardActors() {
+        flush();
+        stopping_.store(true, std::memory_order_release);
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+        map_.setShardsOwned(false);
+    }
+
+    // Core that owns a symbol's book
+    std::size_t coreOf(SymbolId symbol) const {
+        return map_.shardOf(symbol) % cores_;
+    }
+
+    // Queue an insert from producer slot `producer`; each slot must be used by
+    // a single thread. Spins while the owning core's ring is full. Returns
+    // false, queuing nothing, if the lot is not positive.
+    bool insert(std::size_t producer, SymbolId symbol, V lot, int price, Side side = Side::Buy) {
+        if (!(lot > V())) {
+            map_.diagnose(DiagnosticKind::InvalidLot, "insert", symbol, price);
+            return false;
+        }
+        push(producer, {RequestKind::Insert, side, symbol, lot, price});
+        return true;
+    }
+
+    void remove(std::size_t producer, SymbolId symbol) {
+        push(producer, {RequestKind::Remove, Side::Buy, symbol, V(), 0});
+    }
+
+    // Wait until every request queued so far is applied and the owned books'
+    // snapshots are republished
+    void flush() {
+        std::size_t target = 0;
+        for (const auto& count : enqueued_) {
+            target += count.value.load(std::memory_order_acquire);
+        }
+        std::vector<std::size_t> idleSeen;
+        for (const auto& state : states_) {
+            idleSeen.push_back(state->idlePasses.load(std::memory_order_acquire));
+        }
+        while (applied() < target) {
+            std::this_thread::yield();
+        }
+        for (std::size_t core = 0; core < cores_; ++core) {
+            while (states_[core]->idlePasses.load(std::memory_order_acquire) <= idleSeen[core] + 1) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    enum class RequestKind : std::uint8_t { Insert, Remove };
+
+    struct Request {
+        RequestKind kind;
+        Side side;
+        SymbolId symbol;
+        V lotSize;
+        int price;
+    };
+
+    struct alignas(64) Counter {
+        std::atomic<std::size_t> value{0};
+    };
+
+    struct alignas(64) CoreState {
+        std::atomic<std::size_t> applied{0};
+        std::atomic<std::size_t> idlePasses{0};
+    };
+
+    void push(std::size_t producer, const Request& request) {
+        SpscRing<Request>& ring = *rings_[producer * cores_ + coreOf(request.symbol)];
+        while (!ring.tryPush(request)) {
+            std::this_thread::yield();
+        }
+        enqueued_[producer].value.fetch_add(1, std::memory_order_release);
+    }
+
+    std::size_t applied() const {
+        std::size_t total = 0;
+        for (const auto& state : states_) {
+            total += state->applied.load(std::memory_order_acquire);
+        }
+        return total;
+    }
+
+    void run(std::size_t core) {
+        constexpr std::size_t kBatch = 64;
+        constexpr std::size_t kPassesPerRefresh = 64;
+        CoreState& state = *states_[core];
+        std::vector<SymbolId> touched;
+        std::size_t passesSinceRefresh = 0;
+
+        while (true) {
+            std::size_t drained = 0;
+            std::uint64_t lastLsn = 0;
+            for (std::size_t producer = 0; producer < producers_; ++producer) {
+                SpscRing<Request>& ring = *rings_[producer * cores_ + core];
+                Request request;
+                for (std::size_t n = 0; n < kBatch && ring.tryPop(request); ++n) {
+                    const std::uint64_t lsn =
+                        request.kind == RequestKind::Insert
+                            ? map_.applyOwnedInsert(request.symbol, request.lotSize, request.price, request.side)
+                            : map_.applyOwnedRemove(request.symbol);
+                    lastLsn = std::max(lastLsn, lsn);
+                    touched.push_back(request.symbol);
+                    ++drained;
+                }
+            }
+            if (drained > 0) {
+                // One group commit covers the pass, so flush() implies durable
+                map_.awaitDurable(lastLsn);
+                state.applied.fetch_add(drained, std::memory_order_release);
+            }
+
+            // Republish snapshots when idle, and periodically under sustained load
+            if (drained == 0 || ++passesSinceRefresh >= kPassesPerRefresh) {
+                std::sort(touched.begin(), touched.end());
+                touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+                for (SymbolId symbol : touched) {
+                    map_.publishOwnedSnapshot(symbol);
+                }
+                touched.clear();
+                passesSinceRefresh = 0;
+            }
+            if (drained == 0) {
+                state.idlePasses.fetch_add(1, std::memory_order_release);
+                if (stopping_.load(std::memory_order_acquire)) {
+                    return;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    ConcurrentHashMap<K, V, Alloc>& map_;
+    const std::size_t cores_;
+    const std::size_t producers_;
+    std::vector<std::unique_ptr<SpscRing<Request>>> rings_;  // Indexed producer * cores_ + core
+    std::vector<Counter> enqueued_;
+    std::vector<std::unique_ptr<CoreState>> states_;
+    std::vector<std::thread> threads_;
+    std::atomic<bool> stopping_{false};
+};
+
+// Write all of data to fd, continuing after partial writes and signals
+inline bool writeFully(int fd, const void* data, std::size_t bytes) {
+    const char* next = static_cast<const char*>(data);
+    while (bytes > 0) {
+        const ssize_t written = ::write(fd, next, bytes);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        next += written;
+        bytes -= static_cast<std::size_t>(written);
+    }
+    return true;
+}
+
+// Growable text buffer that keeps its capacity across clear(), so rendering
+// into a reused buffer stops allocating once it has reached its peak size.
+// Numbers are formatted with std::to_chars: no locale and no streams.
+// Floating-point values use six significant digits in the general
+// notation, matching what a default ostream prints.
+class FormatBuffer {
+public:
+    void clear() {
+        size_ = 0;
+    }
+
+    const char* data() const {
+        return data_.data();
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    void append(const char* text, std::size_t length) {
+        reserve(length);
+        std::memcpy(data_.data() + size_, text, length);
+        size_ += length;
+    }
+
+    template <std::size_t N>
+    void append(const char (&literal)[N]) {
+        append(literal, N - 1);
+    }
+
+    void append(std::string_view text) {
+        append(text.data(), text.size());
+    }
+
+    template <typename T>
+    void appendNumber(T value) {
+        constexpr std::size_t kMaxDigits = 32;
+        reserve(kMaxDigits);
+        char* const first = data_.data() + size_;
+        std::to_chars_result result;
+        if constexpr (std::is_floating_point<T>::value) {
+            result = std::to_chars(first, first + kMaxDigits, value, std::chars_format::general, 6);
+        } else {
+            result = std::to_chars(first, first + kMaxDigits, value);
+        }
+        size_ = static_cast<std::size_t>(result.ptr - data_.data());
+    }
+
+    // Numbers and string-like values directly; anything else through its
+    // stream operator
+    template <typename T>
+    void appendValue(const T& value) {
+        if constexpr (std::is_arithmetic<T>::value) {
+            appendNumber(value);
+        } else if constexpr (std::is_convertible<const T&, std::string_view>::value) {
+            append(std::string_view(value));
+        } else {
+            std::ostringstream text;
+            text << value;
+            append(text.str());
+        }
+    }
+
+private:
+    void reserve(std::size_t extra) {
+        if (size_ + extra > data_.size()) {
+            data_.resize(std::max(data_.size() * 2, size_ + extra));
+        }
+    }
+
+    std::vector<char> data_;
+    std::size_t size_ = 0;
+};
+
+// Bounded lock-free multi-producer single-consumer ring. Each cell carries a
+// sequence number: producers claim a position with a CAS on the enqueue index
+// and publish the cell by advancing its sequence, so a slow producer never
+// blocks the others and the consumer only ever waits on the cell it needs.
+template <typename T>
+class MpscRing {
+public:
+    explicit MpscRing(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        mask_ = size - 1;
+        cells_.reset(new Cell[size]);
+        for (std::size_t i = 0; i < size; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    std::size_t capacity() const {
+        return mask_ + 1;
+    }
+
+    // Any thread; returns false if the ring is full
+    bool tryPush(const T& value) {
+        std::size_t position = enqueuePos_.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells_[position & mask_];
+            const std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(position);
+            if (diff == 0) {
+                if (enqueuePos_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                position = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer thread only; returns false if the next cell is not yet published
+    bool tryPop(T& value) {
+        const std::size_t position = dequeuePos_.load(std::memory_order_relaxed);
+        Cell& cell = cells_[position & mask_];
+        if (cell.sequence.load(std::memory_order_acquire) != position + 1) {
+            return false;
+        }
+        value = cell.value;
+        cell.sequence.store(position + mask_ + 1, std::memory_order_release);
+        dequeuePos_.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate number of queued elements
+    std::size_t depth() const {
+        const std::size_t dequeued = dequeuePos_.load(std::memory_order_acquire);
+        const std::size_t enqueued = enqueuePos_.load(std::memory_order_acquire);
+        return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+private:
+    struct alignas(64) Cell {
+        std::atomic<std::size_t> sequence{0};
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    std::size_t mask_ = 0;
+    alignas(64) std::atomic<std::size_t> enqueuePos_{0};
+    alignas(64) std::atomic<std::size_t> dequeuePos_{0};
+};
+
+// Outcome of a map operation. Hot paths return it instead of printing, so a
+// bad feed costs a branch and a counter rather than a write under a lock.
+// Rejected means the arguments were invalid and nothing changed; WriteFailed
+// means the change was applied in memory but its journal record is not
+// durable.
+enum class Status : std::uint8_t { Ok, NotFound, TableFull, Duplicate, Rejected, WriteFailed };
+
+// Outcome of MatchingEngine::submit. An order that is not Ok (or
+// WriteFailed, which still rests) has neither traded nor rested.
+template <typename V>
+struct SubmitResult {
+    Status status = Status::Ok;
+    V resting = V();  // Lot left resting after matching
+};
+
+// Fixed-size diagnostic event, copied through the log's ring without
+// allocating. The symbol is named by name if it is set, else by id; action
+// must be a string literal.
+struct Diagnostic {
+    DiagnosticKind kind = DiagnosticKind::SymbolNotFound;
+    const char* action = "";
+    SymbolId symbol = kInvalidSymbol;
+    int price = 0;
+    OrderId order = kNoOrderId;
+    char name[24] = {};
+};
+
+// Asynchronous diagnostics. report() is lock-free and never blocks: it counts
+// the event and, within its kind's per-second budget, queues it in an MPSC
+// ring. A background thread formats whatever is queued into one buffer and
+// writes it with a single write(). Events over budget are only counted and
+// summarised once a second; events that find the ring full are dropped and
+// counted. The budget is approximate at the turn of each second.
+class DiagnosticLog {
+public:
+    explicit DiagnosticLog(int fd = STDERR_FILENO, std::uint32_t perSecond = 32, std::size_t capacity = 1024)
+        : fd_(fd), perSecond_(perSecond), ring_(capacity), flusher_([this]() { run(); }) {}
+
+    DiagnosticLog(const DiagnosticLog& other) = delete;
+    DiagnosticLog& operator=(const DiagnosticLog& other) = delete;
+
+    // Writes everything still queued before returning
+    ~DiagnosticLog() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        flusher_.join();
+    }
+
+    // Process-wide log on stderr, used by maps that are not given another
+    static DiagnosticLog& global() {
+        static DiagnosticLog log;
+        return log;
+    }
+
+    // Any thread
+    void report(const Diagnostic& event) {
+        Counters& counters = counters_[static_cast<std::size_t>(event.kind)];
+        counters.reported.fetch_add(1, std::memory_order_relaxed);
+        const std::uint64_t second = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+        std::uint64_t window = counters.window.load(std::memory_order_relaxed);
+        if (window != second && counters.window.compare_exchange_strong(window, second, std::memory_order_relaxed)) {
+            counters.inWindow.store(0, std::memory_order_relaxed);
+        }
+        if (counters.inWindow.fetch_add(1, std::memory_order_relaxed) >= perSecond_) {
+            counters.suppressed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        if (!ring_.tryPush(event)) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Block until every event reported so far, and the summary of those
+    // suppressed, has been written
+    void flush() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const std::uint64_t ticket = ++flushRequested_;
+        wake_.notify_one();
+        flushed_.wait(lock, [this, ticket]() { return flushedTicket_ >= ticket; });
+    }
+
+    std::uint64_t reported(DiagnosticKind kind) const {
+        return counters_[static_cast<std::size_t>(kind)].reported.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t suppressed(DiagnosticKind kind) const {
+        return counters_[static_cast<std::size_t>(kind)].suppressed.load(std::memory_order_relaxed);
+    }
+
+    std::uint64_t dropped() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct alignas(64) Counters {
+        std::atomic<std::uint64_t> reported{0};
+        std::atomic<std::uint64_t> suppressed{0};
+        std::atomic<std::uint64_t> window{0};
+        std::atomic<std::uint32_t> inWindow{0};
+    };
+
+    static constexpr auto kFlushInterval = std::chrono::milliseconds(50);
+
+    static const char* labelOf(DiagnosticKind kind) {
+        static const char* const labels[kDiagnosticKinds] = {
+            "symbol not found", "symbol table full", "no such level", "order not found",
+            "duplicate order", "order rejected", "write failed", "invalid lot", "shard owned"
+        };
+        return labels[static_cast<std::size_t>(kind)];
+    }
+
+    static void appendSymbol(FormatBuffer& text, const Diagnostic& event) {
+        if (event.name[0] != '\0') {
+            text.append("Symbol ");
+            text.append(std::string_view(event.name, strnlen(event.name, sizeof(event.name))));
+        } else {
+            text.append("Symbol id ");
+            text.appendNumber(event.symbol);
+        }
+    }
+
+    static void format(FormatBuffer& text, const Diagnostic& event) {
+        text.append("Error: ");
+        switch (event.kind) {
+        case DiagnosticKind::SymbolNotFound:
+            appendSymbol(text, event);
+            text.append(" not found for ");
+            text.append(std::string_view(event.action));
+            break;
+        case DiagnosticKind::SymbolTableFull:
+            text.append("Symbol table full, cannot ");
+            text.append(std::string_view(event.action));
+            text.append(" ");
+            text.append(std::string_view(event.name, strnlen(event.name, sizeof(event.name))));
+            break;
+        case DiagnosticKind::NoSuchLevel:
+            appendSymbol(text, event);
+            text.append(" has no level at ");
+            text.appendNumber(event.price);
+            text.append(" to ");
+            text.append(std::string_view(event.action));
+            break;
+        case DiagnosticKind::OrderNotFound:
+            text.append("Order ");
+            text.appendNumber(event.order);
+            text.append(" not found for ");
+            text.append(std::string_view(event.action));
+            break;
+        case DiagnosticKind::DuplicateOrder:
+            text.append("Order ");
+            text.appendNumber(event.order);
+            text.append(" already exists");
+            break;
+        case DiagnosticKind::OrderRejected:
+            text.append("Order ");
+            text.appendNumber(event.order);
+            text.append(" rejected for symbol id ");
+            text.appendNumber(event.symbol);
+            break;
+        case DiagnosticKind::WriteFailed:
+            text.append("Cannot write ");
+            text.append(std::string_view(event.action));
+            break;
+        case DiagnosticKind::InvalidLot:
+            if (event.order != kNoOrderId) {
+                text.append("Order ");
+                text.appendNumber(event.order);
+            } else {
+                appendSymbol(text, event);
+            }
+            text.append(" given an invalid lot to ");
+            text.append(std::string_view(event.action));
+            break;
+        case DiagnosticKind::ShardOwned:
+            // Without a symbol the whole map was refused
+            if (event.name[0] == '\0' && event.symbol == kInvalidSymbol) {
+                text.append("A shard");
+            } else {
+                appendSymbol(text, event);
+            }
+            text.append(" is owned by a shard actor, cannot ");
+            text.append(std::string_view(event.action));
+            break;
+        }
+        text.append(".\n");
+    }
+
+    // Report what was suppressed or dropped since the last summary
+    void summarise(FormatBuffer& text, std::array<std::uint64_t, kDiagnosticKinds>& announced,
+                   std::uint64_t& announcedDrops) const {
+        for (std::size_t kind = 0; kind < kDiagnosticKinds; ++kind) {
+            const std::uint64_t total = counters_[kind].suppressed.load(std::memory_order_relaxed);
+            if (total != announced[kind]) {
+                text.append("Suppressed ");
+                text.appendNumber(total - announced[kind]);
+                text.append(" ");
+                text.append(std::string_view(labelOf(static_cast<DiagnosticKind>(kind))));
+                text.append(" diagnostics.\n");
+                announced[kind] = total;
+            }
+        }
+        const std::uint64_t drops = dropped_.load(std::memory_order_relaxed);
+        if (drops != announcedDrops) {
+            text.append("Dropped ");
+            text.appendNumber(drops - announcedDrops);
+            text.append(" diagnostics on a full queue.\n");
+            announcedDrops = drops;
+        }
+    }
+
+    void run() {
+        FormatBuffer text;
+        std::array<std::uint64_t, kDiagnosticKinds> announced{};
+        std::uint64_t announcedDrops = 0;
+        auto lastSummary = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            wake_.wait_for(lock, kFlushInterval, [this]() {
+                return stopping_ || flushRequested_ != flushedTicket_;
+            });
+            const bool stopping = stopping_;
+            const std::uint64_t ticket = flushRequested_;
+            lock.unlock();
+
+            text.clear();
+            Diagnostic event;
+            while (ring_.tryPop(event)) {
+                format(text, event);
+            }
+            const auto now = std::chrono::steady_clock::now();
+            if (stopping || ticket != flushedTicket_ || now - lastSummary >= std::chrono::seconds(1)) {
+                summarise(text, announced, announcedDrops);
+                lastSummary = now;
+            }
+            if (text.size() > 0) {
+                writeFully(fd_, text.data(), text.size());  // Nowhere left to report a failure
+            }
+
+            lock.lock();
+            flushedTicket_ = ticket;
+            flushed_.notify_all();
+            if (stopping) {
+                return;
+            }
+        }
+    }
+
+    const int fd_;
+    const std::uint32_t perSecond_;
+    MpscRing<Diagnostic> ring_;
+    std::array<Counters, kDiagnosticKinds> counters_;
+    alignas(64) std::atomic<std::uint64_t> dropped_{0};
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable flushed_;
+    bool stopping_ = false;
+    std::uint64_t flushRequested_ = 0;
+    std::uint64_t flushedTicket_ = 0;
+    std::thread flusher_;
+};
+
+// What a producer does when the ingress ring is full
+enum class BackpressurePolicy { Spin, Yield, Drop };
+
+// Counters exposed by IngressQueue
+struct IngressMetrics {
+    std::size_t enqueued = 0;
+    std::size_t applied = 0;   // Updates that reached the books
+    std::size_t rejected = 0;  // Updates insertBatch refused; it reports each one
+    std::size_t dropped = 0;
+    std::size_t batches = 0;
+    std::size_t failedBatches = 0;  // Batches with at least one refused update
+    std::size_t depth = 0;
+    std::size_t highWaterMark = 0;
+};
+
+// Non-blocking ingress in front of ConcurrentHashMap::insert. Producers only
+// enqueue into a bounded MPSC ring; a dedicated applier thread drains it in
+// batches through insertBatch, so network threads never wait on map locks.
+template <typename K, typename V, typename Alloc = std::allocator<char>>
+class IngressQueue {
+public:
+    IngressQueue(ConcurrentHashMap<K, V, Alloc>& map, std::size_t capacity = 65536,
+                 BackpressurePolicy policy = BackpressurePolicy::Yield, std::size_t maxBatch = 256)
+        : map_(map), ring_(capacity), policy_(policy), maxBatch_(std::max<std::size_t>(1, maxBatch)) {
+        applier_ = std::thread([this]() {
+            run();
+        });
+    }
+
+    IngressQueue(const IngressQueue& other) = delete;
+    IngressQueue& operator=(const IngressQueue& other) = delete;
+
+    // Apply everything already queued, then stop the applier
+    ~IngressQueue() {
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            stopping_.store(true, std::memory_order_release);
+        }
+        wake_.notify_one();
+        applier_.join();
+    }
+
+    // Queue an insert; returns false if the lot is not positive or the
+    // insert was dropped under the Drop policy
+    bool insert(SymbolId symbol, V lot, int price, Side side = Side::Buy) {
+        if (!(lot > V())) {
+            map_.diagnose(DiagnosticKind::InvalidLot, "insert", symbol, price);
+            return false;
+        }
+        const OrderUpdate<V> update{symbol, lot, price, side};
+        while (!ring_.tryPush(update)) {
+            if (policy_ == BackpressurePolicy::Drop) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (policy_ == BackpressurePolicy::Yield) {
+                std::this_thread::yield();
+            }
+        }
+        // Pairs with the applier's store to sleeping_: either it sees this
+        // insert before parking or this sees it parked and wakes it
+        enqueued_.fetch_add(1, std::memory_order_seq_cst);
+        if (sleeping_.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(sleepMutex_);
+            wake_.notify_one();
+        }
+        return true;
+    }
+
+    // Queue an insert by symbol name; interning is lock-free
+    bool insert(const K& symbol, V lot, int price, Side side = Side::Buy) {
+        const SymbolId id = map_.intern(symbol);
+        if (id == kInvalidSymbol) {
+            map_.diagnose(DiagnosticKind::SymbolTableFull, "insert", symbol);
+            return false;
+        }
+        return insert(id, lot, price, side);
+    }
+
+    // Wait until every insert queued so far has been applied to the map
+    void flush() {
+        const std::size_t target = enqueued_.load(std::memory_order_acquire);
+        while (processed_.load(std::memory_order_acquire) < target) {
+            std::this_thread::yield();
+        }
+    }
+
+    IngressMetrics metrics() const {
+        IngressMetrics metrics;
+        metrics.enqueued = enqueued_.load(std::memory_order_relaxed);
+        // A batch's refusals are counted before it is marked processed, so a
+        // concurrent read may see them early; clamp rather than underflow
+        const std::size_t processed = processed_.load(std::memory_order_acquire);
+        metrics.rejected = std::min(rejected_.load(std::memory_order_relaxed), processed);
+        metrics.applied = processed - metrics.rejected;
+        metrics.dropped = dropped_.load(std::memory_order_relaxed);
+        metrics.batches = batches_.load(std::memory_order_relaxed);
+        metrics.failedBatches = failedBatches_.load(std::memory_order_relaxed);
+        metrics.depth = ring_.depth();
+        metrics.highWaterMark = highWaterMark_.load(std::memory_order_relaxed);
+        return metrics;
+    }
+
+private:
+    // Idle passes spent yielding before the applier parks
+    static constexpr std::size_t kSpinPasses = 64;
+
+    void run() {
+        std::vector<OrderUpdate<V>> batch;
+        batch.reserve(maxBatch_);
+        std::size_t idlePasses = 0;
+        while (true) {
+            const std::size_t depth = ring_.depth();
+            if (depth > highWaterMark_.load(std::memory_order_relaxed)) {
+                highWaterMark_.store(depth, std::memory_order_relaxed);
+            }
+
+            batch.clear();
+            OrderUpdate<V> update;
+            while (batch.size() < maxBatch_ && ring_.tryPop(update)) {
+                batch.push_back(update);
+            }
+            if (!batch.empty()) {
+                std::size_t refused = 0;
+                if (map_.insertBatch(batch.data(), batch.size(), &refused) != Status::Ok) {
+                    failedBatches_.fetch_add(1, std::memory_order_relaxed);
+                }
+                rejected_.fetch_add(refused, std::memory_order_relaxed);
+                batches_.fetch_add(1, std::memory_order_relaxed);
+                processed_.fetch_add(batch.size(), std::memory_order_release);
+                idlePasses = 0;
+                continue;
+            }
+            if (stopping_.load(std::memory_order_acquire)) {
+                return;
+            }
+            if (++idlePasses < kSpinPasses) {
+                std::this_thread::yield();
+                continue;
+            }
+            // Park until a producer queues more or the queue is stopped
+            std::unique_lock<std::mutex> lock(sleepMutex_);
+            sleeping_.store(true, std::memory_order_seq_cst);
+            wake_.wait(lock, [this]() {
+                return enqueued_.load(std::memory_order_seq_cst) > processed_.load(std::memory_order_relaxed) ||
+                       stopping_.load(std::memory_order_relaxed);
+            });
+            sleeping_.store(false, std::memory_order_relaxed);
+            idlePasses = 0;
+        }
+    }
+
+    ConcurrentHashMap<K, V, Alloc>& map_;
+    MpscRing<OrderUpdate<V>> ring_;
+    const BackpressurePolicy policy_;
+    const std::size_t maxBatch_;
+    std::thread applier_;
+    std::atomic<bool> stopping_{false};
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    alignas(64) std::atomic<std::size_t> enqueued_{0};
+    std::atomic<std::size_t> dropped_{0};
+    alignas(64) std::atomic<std::size_t> processed_{0};  // Applied or refused
+    std::atomic<std::size_t> rejected_{0};
+    std::atomic<bool> sleeping_{false};  // Set by the applier while parked
+    std::atomic<std::size_t> batches_{0};
+    std::atomic<std::size_t> failedBatches_{0};
+    std::atomic<std::size_t> highWaterMark_{0};
+};
+
+// Kind of an L2 delta: a level's new aggregate lot, or every level of the
+// symbol dropped at once
+enum class DeltaKind : std::uint8_t { Level, Clear };
+
+// One book change as seen by market-data consumers. A Level record carries
+// the new aggregate lot at (symbol, side, price); zero means the level is gone.
+struct L2Delta {
+    std::uint64_t sequence;  // 1-based position in the stream
+    SymbolId symbol;
+    Side side;
+    DeltaKind kind;
+    std::int32_t price;
+    std::int64_t lot;
+};
+
+// Lock-free broadcast ring of L2 deltas in POSIX shared memory. Any number
+// of threads publish by claiming a position from a shared cursor; consumer
+// processes map the segment read-only and poll it without syscalls, each at
+// its own pace. Slots are stamped seqlock-style, so a reader that falls a
+// full ring behind sees an overrun instead of torn records.
+class L2DeltaRing {
+public:
+    enum class ReadStatus { Ok, Empty, Overrun };
+
+    // Create (or replace) the named segment for publishing; nullptr on failure
+    static std::unique_ptr<L2DeltaRing> create(const std::string& name, std::size_t capacity = 1 << 16) {
+        std::size_t slots = 1;
+        while (slots < capacity) {
+            slots <<= 1;
+        }
+        const std::size_t bytes = sizeof(Header) + slots * sizeof(Slot);
+        const int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+        if (fd < 0 || ftruncate(fd, static_cast<off_t>(bytes)) != 0) {
+            std::cerr << "Error: Cannot create shared memory " << name << "." << std::endl;
+            if (fd >= 0) {
+                close(fd);
+            }
+            return nullptr;
+        }
+        void* base = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            std::cerr << "Error: Cannot map shared memory " << name << "." << std::endl;
+            return nullptr;
+        }
+        // The new segment is zero-filled, which is a valid empty ring
+        Header* header = new (base) Header();
+        header->capacity = slots;
+        header->magic = kMagic;
+        return std::unique_ptr<L2DeltaRing>(new L2DeltaRing(base, bytes));
+    }
+
+    // Map an existing segment read-only for consuming; nullptr on failure
+    static std::unique_ptr<L2DeltaRing> open(const std::string& name) {
+        const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(Header)) {
+            std::cerr << "Error: Cannot open shared memory " << name << "." << std::endl;
+            if (fd >= 0) {
+                close(fd);
+            }
+            return nullptr;
+        }
+        const std::size_t bytes = static_cast<std::size_t>(info.st_size);
+        void* base = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED || !validSegment(*static_cast<const Header*>(base), bytes)) {
+            std::cerr << "Error: " << name << " is not an L2 delta ring." << std::endl;
+            if (base != MAP_FAILED) {
+                munmap(base, bytes);
+            }
+            return nullptr;
+        }
+        return std::unique_ptr<L2DeltaRing>(new L2DeltaRing(base, bytes));
+    }
+
+    // Remove the named segment; existing mappings stay valid
+    static void remove(const std::string& name) {
+        shm_unlink(name.c_str());
+    }
+
+    L2DeltaRing(const L2DeltaRing& other) = delete;
+    L2DeltaRing& operator=(const L2DeltaRing& other) = delete;
+
+    ~L2DeltaRing() {
+        munmap(base_, bytes_);
+    }
+
+    // Append one record; safe from any number of threads. Waits if the
+    // writer of the same slot one lap earlier has not finished, so that its
+    // completing stamp cannot land on top of this record's.
+    void publish(SymbolId symbol, Side side, DeltaKind kind, int price, std::int64_t lot) {
+        const std::uint64_t position = header_->cursor.fetch_add(1, std::memory_order_relaxed);
+        const std::uint64_t capacity = header_->capacity;
+        Slot& slot = slots_[position & (capacity - 1)];
+        const std::uint64_t previous = position < capacity ? 0 : 2 * (position - capacity) + 2;
+        while (slot.stamp.load(std::memory_order_acquire) != previous) {
+            std::this_thread::yield();
+        }
+        slot.stamp.store(2 * position + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.key.store(static_cast<std::uint64_t>(symbol) |
+                       static_cast<std::uint64_t>(side) << 32 |
+                       static_cast<std::uint64_t>(kind) << 40, std::memory_order_relaxed);
+        slot.price.store(price, std::memory_order_relaxed);
+        slot.lot.store(lot, std::memory_order_relaxed);
+        slot.stamp.store(2 * position + 2, std::memory_order_release);
+    }
+
+    // Read the record at a 0-based position. Empty means it is not written
+    // yet; Overrun means it was already overwritten by a later lap.
+    ReadStatus read(std::uint64_t position, L2Delta& delta) const {
+        const Slot& slot = slots_[position & (header_->capacity - 1)];
+        const std::uint64_t expected = 2 * position + 2;
+        const std::uint64_t before = slot.stamp.load(std::memory_order_acquire);
+        if (before != expected) {
+            return before < expected ? ReadStatus::Empty : ReadStatus::Overrun;
+        }
+        const std::uint64_t key = slot.key.load(std::memory_order_relaxed);
+        delta.price = static_cast<std::int32_t>(slot.price.load(std::memory_order_relaxed));
+        delta.lot = slot.lot.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.stamp.load(std::memory_order_relaxed) != before) {
+            return ReadStatus::Overrun;
+        }
+        delta.sequence = position + 1;
+        delta.symbol = static_cast<SymbolId>(key);
+        delta.side = static_cast<Side>((key >> 32) & 0xFF);
+        delta.kind = static_cast<DeltaKind>((key >> 40) & 0xFF);
+        return ReadStatus::Ok;
+    }
+
+    // Number of records published so far
+    std::uint64_t published() const {
+        return header_->cursor.load(std::memory_order_acquire);
+    }
+
+    std::size_t capacity() const {
+        return static_cast<std::size_t>(header_->capacity);
+    }
+
+private:
+    static constexpr std::uint64_t kMagic = 0x4c3244454c544131ull;  // "L2DELTA1"
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+                  "shared-memory ring needs address-free 64-bit atomics");
+
+    struct Header {
+        std::uint64_t magic = 0;
+        std::uint64_t capacity = 0;
+        alignas(64) std::atomic<std::uint64_t> cursor{0};
+    };
+
+    // 2 * position + 1 while being written, 2 * position + 2 once complete
+    struct alignas(32) Slot {
+        std::atomic<std::uint64_t> stamp;
+        std::atomic<std::uint64_t> key;
+        std::atomic<std::int64_t> price;
+        std::atomic<std::int64_t> lot;
+    };
+
+    // True if a mapped segment is a ring whose slots all lie inside bytes;
+    // the capacity is checked by division so a foreign header cannot overflow
+    static bool validSegment(const Header& header, std::size_t bytes) {
+        const std::uint64_t capacity = header.capacity;
+        return header.magic == kMagic && capacity != 0 && (capacity & (capacity - 1)) == 0 &&
+               capacity <= (bytes - sizeof(Header)) / sizeof(Slot);
+    }
+
+    L2DeltaRing(void* base, std::size_t bytes)
+        : base_(base),
+          bytes_(bytes),
+          header_(static_cast<Header*>(base)),
+          slots_(reinterpret_cast<Slot*>(static_cast<char*>(base) + sizeof(Header))) {}
+
+    void* base_;
+    std::size_t bytes_;
+    Header* header_;
+    Slot* slots_;
+};
+
+// Book rebuilt by a consumer from a delta stream
+class L2Replica {
+public:
+    void apply(const L2Delta& delta) {
+        if (delta.kind == DeltaKind::Clear) {
+            books_.erase(delta.symbol);
+            return;
+        }
+        auto& levels = books_[delta.symbol][delta.side == Side::Buy ? 0 : 1];
+        if (delta.lot == 0) {
+            levels.erase(delta.price);
+        } else {
+            levels[delta.price] = delta.lot;
+        }
+    }
+
+    // Aggregate lot at a level, zero if absent
+    std::int64_t lot(SymbolId symbol, Side side, int price) const {
+        auto book = books_.find(symbol);
+        if (book == books_.end()) {
+            return 0;
+        }
+        const auto& levels = book->second[side == Side::Buy ? 0 : 1];
+        auto level = levels.find(price);
+        return level == levels.end() ? 0 : level->second;
+    }
+
+    std::size_t depth(SymbolId symbol) const {
+        auto book = books_.find(symbol);
+        return book == books_.end() ? 0 : book->second[0].size() + book->second[1].size();
+    }
+
+    void print(std::ostream& out) const {
+        for (const auto& book : books_) {
+            out << "symbol " << book.first << ": ";
+            for (const auto& level : book.second[0]) {
+                out << "{lotSize: " << level.second << ", price: " << level.first << "} ";
+            }
+            if (!book.second[1].empty()) {
+                out << "| asks: ";
+                for (const auto& level : book.second[1]) {
+                    out << "{lotSize: " << level.second << ", price: " << level.first << "} ";
+                }
+            }
+            out << std::endl;
+        }
+    }
+
+private:
+    std::map<SymbolId, std::map<int, std::int64_t>[2]> books_;
+};
+
+// Action carried by one order-log record. Remove drops a symbol's whole
+// book; Symbol, used by journals, names the id in its symbol field.
+enum class LogAction : std::uint8_t { Add, Cancel, Modify, Reduce, Remove, Symbol };
+
+// Fixed 24-byte order-log record. symbol indexes the log's own symbol table;
+// an Add with orderId kNoOrderId is anonymous lot that cannot be cancelled.
+struct OrderLogRecord {
+    std::uint64_t orderId;
+    std::uint32_t symbol;
+    std::int32_t price;
+    std::int32_t lot;
+    LogAction action;
+    Side side;
+    std::uint16_t reserved;
+};
+
+static_assert(sizeof(OrderLogRecord) == 24, "order-log records are 24 bytes on disk");
+
+// False for a record whose action or side is out of range, as a corrupt
+// file may hold
+inline bool validRecord(const OrderLogRecord& record) {
+    return record.action <= LogAction::Symbol && record.side <= Side::Sell;
+}
+
+// Binary order log: this header, symbolCount NUL-padded names of
+// kLogSymbolBytes each, then recordCount records, all little-endian
+struct OrderLogHeader {
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t symbolCount;
+    std::uint64_t recordCount;
+};
+
+constexpr std::uint64_t kOrderLogMagic = 0x31474f4c4b4f4f42ull;  // "BOOKLOG1"
+constexpr std::size_t kLogSymbolBytes = 16;
+
+// Write an order log; returns false if the file cannot be written or a
+// symbol does not fit its kLogSymbolBytes - 1 byte name field
+inline bool writeOrderLog(const std::string& path, const std::vector<std::string>& symbols,
+                          const std::vector<OrderLogRecord>& records) {
+    for (const auto& symbol : symbols) {
+        if (symbol.size() >= kLogSymbolBytes) {
+            std::cerr << "Error: Symbol " << symbol << " is too long for order log " << path << "." << std::endl;
+            return false;
+        }
+    }
+    std::unique_ptr<FILE, int (*)(FILE*)> file(std::fopen(path.c_str(), "wb"), &std::fclose);
+    if (file == nullptr) {
+        std::cerr << "Error: Cannot write order log " << path << "." << std::endl;
+        return false;
+    }
+    const OrderLogHeader header{kOrderLogMagic, 1, static_cast<std::uint32_t>(symbols.size()), records.size()};
+    bool ok = std::fwrite(&header, sizeof(header), 1, file.get()) == 1;
+    for (const auto& symbol : symbols) {
+        char name[kLogSymbolBytes] = {};
+        symbol.copy(name, kLogSymbolBytes - 1);
+        ok = ok && std::fwrite(name, sizeof(name), 1, file.get()) == 1;
+    }
+    ok = ok && std::fwrite(records.data(), sizeof(OrderLogRecord), records.size(), file.get()) == records.size();
+    if (!ok) {
+        std::cerr << "Error: Cannot write order log " << path << "." << std::endl;
+    }
+    return ok;
+}
+
+// Read-only memory mapping of an order log. Records are used in place, so
+// replay never copies or parses them.
+class MappedOrderLog {
+public:
+    // Map and validate a log; nullptr on failure
+    static std::unique_ptr<MappedOrderLog> open(const std::string& path) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(OrderLogHeader)) {
+            std::cerr << "Error: Cannot open order log " << path << "." << std::endl;
+            if (fd >= 0) {
+                close(fd);
+            }
+            return nullptr;
+        }
+        const std::size_t bytes = static_cast<std::size_t>(info.st_size);
+        void* base = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            std::cerr << "Error: Cannot map order log " << path << "." << std::endl;
+            return nullptr;
+        }
+        madvise(base, bytes, MADV_SEQUENTIAL);
+
+        std::unique_ptr<MappedOrderLog> log(new MappedOrderLog(base, bytes));
+        // Counts are checked by division so a corrupt header cannot overflow
+        const OrderLogHeader& header = *static_cast<const OrderLogHeader*>(base);
+        const std::size_t body = bytes - sizeof(OrderLogHeader);
+        const std::size_t names = static_cast<std::size_t>(header.symbolCount) * kLogSymbolBytes;
+        if (header.magic != kOrderLogMagic || header.version != 1 || body < names ||
+            header.recordCount > (body - names) / sizeof(OrderLogRecord)) {
+            std::cerr << "Error: " << path << " is not a valid order log." << std::endl;
+            return nullptr;
+        }
+        return log;
+    }
+
+    MappedOrderLog(const MappedOrderLog& other) = delete;
+    MappedOrderLog& operator=(const MappedOrderLog& other) = delete;
+
+    ~MappedOrderLog() {
+        munmap(base_, bytes_);
+    }
+
+    std::size_t symbolCount() const {
+        return header().symbolCount;
+    }
+
+    std::string symbol(std::size_t index) const {
+        const char* name = static_cast<const char*>(base_) + sizeof(OrderLogHeader) + index * kLogSymbolBytes;
+        return std::string(name, strnlen(name, kLogSymbolBytes));
+    }
+
+    std::size_t recordCount() const {
+        return header().recordCount;
+    }
+
+    const OrderLogRecord* records() const {
+        return reinterpret_cast<const OrderLogRecord*>(
+            static_cast<const char*>(base_) + sizeof(OrderLogHeader) + symbolCount() * kLogSymbolBytes);
+    }
+
+private:
+    MappedOrderLog(void* base, std::size_t bytes) : base_(base), bytes_(bytes) {}
+
+    const OrderLogHeader& header() const {
+        return *static_cast<const OrderLogHeader*>(base_);
+    }
+
+    void* base_;
+    std::size_t bytes_;
+};
+
+// Outcome of one replay run
+struct ReplayStats {
+    std::size_t records = 0;
+    std::size_t rejected = 0;  // Records the map refused, such as unknown cancels
+    std::size_t skipped = 0;   // Journal records already covered by a checkpoint
+    double seconds = 0.0;
+
+    double ordersPerSecond() const {
+        return seconds > 0.0 ? records / seconds : 0.0;
+    }
+};
+
+template <typename K, typename V, typename Alloc>
+ReplayStats replayOrderLog(ConcurrentHashMap<K, V, Alloc>& map, const MappedOrderLog& log, std::size_t threads = 1);
+
+// Pack a symbol name into Symbol records for id, passing each to emit. A
+// record holds kLogSymbolBytes of the name in its orderId, price and lot
+// fields and, in reserved, the number of records still to follow, so names
+// of any length survive.
+template <typename F>
+void packSymbolName(std::uint32_t id, const std::string& name, F&& emit) {
+    const std::size_t chunks = std::max<std::size_t>(1, (name.size() + kLogSymbolBytes - 1) / kLogSymbolBytes);
+    for (std::size_t chunk = 0; chunk < chunks; ++chunk) {
+        char bytes[kLogSymbolBytes] = {};
+        name.copy(bytes, kLogSymbolBytes, chunk * kLogSymbolBytes);
+        OrderLogRecord record{};
+        record.symbol = id;
+        record.action = LogAction::Symbol;
+        record.reserved = static_cast<std::uint16_t>(chunks - 1 - chunk);
+        std::memcpy(&record.orderId, bytes, 8);
+        std::memcpy(&record.price, bytes + 8, 4);
+        std::memcpy(&record.lot, bytes + 12, 4);
+        emit(record);
+    }
+}
+
+// Append one Symbol record's part of a name; the name is complete once a
+// record with reserved of zero has been appended
+inline void unpackSymbolName(std::string& name, const OrderLogRecord& record) {
+    char bytes[kLogSymbolBytes];
+    std::memcpy(bytes, &record.orderId, 8);
+    std::memcpy(bytes + 8, &record.price, 4);
+    std::memcpy(bytes + 12, &record.lot, 4);
+    name.append(bytes, strnlen(bytes, kLogSymbolBytes));
+}
+
+// Checkpoint file: this header, bookCount book entries, then every book's
+// levels (bids then asks, ascending), then every book's indexed orders, then
+// nameBytes of symbol names. Each book names its own slices, so books can be
+// rebuilt independently, and names are stored at their full length.
+struct CheckpointHeader {
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t bookCount;
+    std::uint64_t levelCount;
+    std::uint64_t orderCount;
+    std::uint64_t nameBytes;
+};
+
+struct CheckpointBook {
+    std::uint64_t nameOffset;  // Into the name table
+    std::uint64_t journalLsn;  // Journal records up to this one are included
+    std::uint64_t firstLevel;
+    std::uint64_t firstOrder;
+    std::uint32_t nameLength;
+    std::uint32_t bidCount;
+    std::uint32_t askCount;
+    std::uint32_t orderCount;
+};
+
+struct CheckpointLevel {
+    std::int32_t price;
+    std::int32_t reserved;
+    std::int64_t lot;
+};
+
+struct CheckpointOrder {
+    std::uint64_t orderId;
+    std::int32_t price;
+    Side side;
+    std::uint8_t reserved[3];
+    std::int64_t lot;
+};
+
+static_assert(sizeof(CheckpointBook) == 48 && sizeof(CheckpointLevel) == 16 && sizeof(CheckpointOrder) == 24,
+              "checkpoint records have a fixed on-disk size");
+
+constexpr std::uint64_t kCheckpointMagic = 0x31504b434b4f4f42ull;  // "BOOKCKP1"
+constexpr std::uint32_t kCheckpointVersion = 2;
+
+constexpr std::uint64_t kJournalMagic = 0x314c4e4a4b4f4f42ull;  // "BOOKJNL1"
+
+// Append-only write-ahead journal of order-log records with group commit.
+// Writers append under a short lock and then wait in commit(). The first
+// waiter to find no flush running becomes the leader: it writes everything
+// appended so far with one write() and one fdatasync() while the others wait
+// for it, so threads share the cost of each sync. Symbol records name the
+// ids the other records refer to.
+class Journal {
+public:
+    // Open a journal for appending, creating it if needed; nullptr on failure,
+    // including when an existing file is not a version 1 journal
+    static std::unique_ptr<Journal> open(const std::string& path) {
+        const int fd = ::open(path.c_str(), O_CREAT | O_RDWR | O_APPEND, 0644);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0) {
+            std::cerr << "Error: Cannot open journal " << path << "." << std::endl;
+            if (fd >= 0) {
+                close(fd);
+            }
+            return nullptr;
+        }
+        std::unique_ptr<Journal> journal(new Journal(fd));
+        if (info.st_size == 0) {
+            const OrderLogHeader header{kJournalMagic, 1, 0, 0};
+            if (::write(fd, &header, sizeof(header)) != static_cast<ssize_t>(sizeof(header)) || fdatasync(fd) != 0) {
+                std::cerr << "Error: Cannot write journal " << path << "." << std::endl;
+                return nullptr;
+            }
+            return journal;
+        }
+        // Never append to a file that recoverJournal would not accept
+        OrderLogHeader header;
+        if (static_cast<std::size_t>(info.st_size) < sizeof(header) ||
+            ::pread(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+            header.magic != kJournalMagic || header.version != 1) {
+            std::cerr << "Error: " << path << " is not a valid journal." << std::endl;
+            return nullptr;
+        }
+        // Continue the sequence numbers of the records already there, first
+        // dropping a torn record a crash may have left at the end
+        const std::size_t records = (static_cast<std::size_t>(info.st_size) - sizeof(header)) / sizeof(OrderLogRecord);
+        const off_t whole = static_cast<off_t>(sizeof(header) + records * sizeof(OrderLogRecord));
+        if (whole != info.st_size && ftruncate(fd, whole) != 0) {
+            std::cerr << "Error: Cannot repair journal " << path << "." << std::endl;
+            return nullptr;
+        }
+        journal->appended_ = records;
+        journal->durable_ = records;
+        return journal;
+    }
+
+    Journal(const Journal& other) = delete;
+    Journal& operator=(const Journal& other) = delete;
+
+    ~Journal() {
+        commit(appended());
+        close(fd_);
+    }
+
+    // Queue a record; returns its 1-based log sequence number, or 0 once a
+    // write has failed, as nothing after a failure can be made durable
+    std::uint64_t append(const OrderLogRecord& record) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (failed_) {
+            return 0;
+        }
+        pending_.push_back(record);
+        return ++appended_;
+    }
+
+    // Block until every record up to lsn is on disk; false if a write has
+    // failed, whichever record it was
+    bool commit(std::uint64_t lsn) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (durable_ < lsn && !failed_) {
+            if (flushing_) {
+                flushed_.wait(lock);
+                continue;
+            }
+            flushing_ = true;
+            writing_.swap(pending_);
+            const std::uint64_t upTo = appended_;
+            lock.unlock();
+            const bool ok = writeAll(writing_) && fdatasync(fd_) == 0;
+            lock.lock();
+            writing_.clear();
+            flushing_ = false;
+            if (ok) {
+                durable_ = upTo;
+                ++syncs_;
+            } else {
+                failed_ = true;
+                pending_.clear();
+            }
+            flushed_.notify_all();
+        }
+        return !failed_;
+    }
+
+    std::uint64_t appended() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return appended_;
+    }
+
+    // Number of fdatasync calls so far, one per group commit
+    std::uint64_t syncs() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return syncs_;
+    }
+
+private:
+    explicit Journal(int fd) : fd_(fd) {}
+
+    bool writeAll(const std::vector<OrderLogRecord>& records) {
+        return writeFully(fd_, records.data(), records.size() * sizeof(OrderLogRecord));
+    }
+
+    const int fd_;
+    mutable std::mutex mutex_;
+    std::condition_variable flushed_;
+    std::vector<OrderLogRecord> pending_;  // Appended, not yet being written
+    std::vector<OrderLogRecord> writing_;  // Owned by the current leader
+    std::uint64_t appended_ = 0;
+    std::uint64_t durable_ = 0;
+    std::uint64_t syncs_ = 0;
+    bool flushing_ = false;
+    bool failed_ = false;
+};
+
+template <typename K, typename V, typename Alloc>
+ReplayStats recoverJournal(ConcurrentHashMap<K, V, Alloc>& map, const std::string& path);
+
+// Consistent per-symbol view returned by lock-free readers. The range,
+// depth and total lot cover both sides of the book.
+template <typename V>
+struct BookSummary {
+    bool live = false;
+    int lowPrice = 0;
+    int highPrice = 0;
+    std::size_t depth = 0;
+    V totalLot = V();
+};
+
+// Best bid and best offer of a book with the aggregated lot at each
+template <typename V>
+struct TopOfBook {
+    bool live = false;
+    bool hasBid = false;
+    bool hasAsk = false;
+    int bidPrice = 0;
+    V bidLot = V();
+    int askPrice = 0;
+    V askLot = V();
+
+    // Ask minus bid; only meaningful when both sides are present
+    int spread() const {
+        return askPrice - bidPrice;
+    }
+};
+
+// Alloc supplies the price-level nodes of every book; pass an
+// ArenaAllocator to draw them from a SlabArena. Books themselves live in one
+// contiguous array allocated at construction.
+template <typename K, typename V, typename Alloc>
+class ConcurrentHashMap {
+public:
+    // Symbols are spread over shardCount independently locked stripes; the
+    // default of one shard behaves like a single globally locked map.
+    // symbolCapacity bounds the number of distinct symbols for the day.
+    explicit ConcurrentHashMap(std::size_t shardCount = 1, std::size_t symbolCapacity = 8192,
+                               const Alloc& alloc = Alloc())
+        : shards_(shardCount == 0 ? 1 : shardCount),
+          index_(symbolCapacity),
+          books_(new Book[symbolCapacity]) {
+        for (std::size_t i = 0; i < symbolCapacity; ++i) {
+            books_[i].bids.useAllocator(alloc);
+            books_[i].asks.useAllocator(alloc);
+        }
+    }
+
+    // Most distinct symbols the map can hold
+    std::size_t symbolCapacity() const {
+        return index_.capacity();
+    }
+
+    // Number of independently locked stripes
+    std::size_t shardCount() const {
+        return shards_.size();
+    }
+
+    // Shard of an interned symbol, used to route work to the shard's owner
+    std::size_t shardOf(SymbolId id) const {
+        const Book* book = bookFor(id);
+        return book == nullptr ? 0 : book->shard;
+    }
+
+    // Resolve a symbol to its dense id, interning it on first sight. Intended
+    // to be called once per symbol at session start; returns kInvalidSymbol
+    // when the symbol capacity is exhausted.
+    SymbolId intern(const K& symbol) {
+        const std::size_t hash = hashOf(symbol);
+        return index_.intern(symbol, hash, [this, &symbol, hash](SymbolId id) {
+            Book& book = books_[id];
+            book.symbol = symbol;
+            book.shard = hash % shards_.size();
+            if (Journal* journal = journal_.load(std::memory_order_acquire)) {
+                journalSymbol(*journal, id, symbol);
+            }
+            book.interned.store(true, std::memory_order_release);
+        });
+    }
+
+    // Find the id of an already interned symbol without interning it
+    SymbolId lookup(const K& symbol) const {
+        return index_.find(symbol, hashOf(symbol));
+    }
+
+    // True if id names an interned symbol
+    bool isInterned(SymbolId id) const {
+        return bookFor(id) != nullptr;
+    }
+
+    // Insert a new order or update an existing one
+    Status insert(const K& symbol, Order<K, V>&& order) {
+        if (order.id == kNoOrderId) {
+            return insert(symbol, order.lotSize, order.price, order.side);
+        }
+        const SymbolId id = intern(symbol);
+        if (id == kInvalidSymbol) {
+            diagnose(DiagnosticKind::SymbolTableFull, "insert", symbol);
+            return Status::TableFull;
+        }
+        return addOrder(id, order.id, order.lotSize, order.price, order.side);
+    }
+
+    // Add lot at price without building a temporary Order; once the symbol
+    // and level exist this path performs no allocation. Rejected if the lot
+    // is not positive.
+    Status insert(const K& symbol, V lot, int price, Side side = Side::Buy) {
+        const SymbolId id = intern(symbol);
+        if (id == kInvalidSymbol) {
+            diagnose(DiagnosticKind::SymbolTableFull, "insert", symbol);
+            return Status::TableFull;
+        }
+        return addToBook(books_[id], lot, price, side);
+    }
+
+    // Add lot at price for an interned symbol; no string hashing or comparison
+    Status insert(SymbolId id, V lot, int price, Side side = Side::Buy) {
+        Book* book = bookFor(id);
+        if (book == nullptr) {
+            diagnose(DiagnosticKind::SymbolNotFound, "insert", id);
+            return Status::NotFound;
+        }
+        return addToBook(*book, lot, price, side);
+    }
+
+    // Apply a packet of updates, taking each shard lock once. Updates are
+    // grouped by shard (keeping their relative order within a shard) and the
+    // target books are prefetched a few updates ahead of use. Returns
+    // Rejected if any update's shard is owned by a shard actor or had a lot
+    // that is not positive or that the journal cannot hold, else NotFound if
+    // any update named an unknown symbol; those updates are skipped and, if
+    // refused is given, their number is stored in it.
+    Status insertBatch(const OrderUpdate<V>* updates, std::size_t count, std::size_t* refused = nullptr) {
+        // Per-thread scratch reused across packets so batching does not allocate
+        static thread_local std::vector<std::uint32_t> batchShards;
+        static thread_local std::vector<std::uint32_t> grouped;
+        static thread_local std::vector<std::size_t> starts;
+        static thread_local std::vector<std::size_t> cursor;
+        constexpr std::uint32_t kSkipped = 0xFFFFFFFFu;
+        bool skipped = false;
+        bool rejected = false;
+
+        const std::size_t shardCount = shards_.size();
+        batchShards.resize(count);
+        grouped.resize(count);
+        starts.assign(shardCount + 1, 0);
+
+        // Counting sort of update indexes by shard
+        for (std::size_t i = 0; i < count; ++i) {
+            const Book* book = bookFor(updates[i].symbol);
+            if (book == nullptr) {
+                diagnose(DiagnosticKind::SymbolNotFound, "insert", updates[i].symbol);
+                batchShards[i] = kSkipped;
+                skipped = true;
+                continue;
+            }
+            if (!(updates[i].lotSize > V())) {
+                diagnose(DiagnosticKind::InvalidLot, "insert", updates[i].symbol, updates[i].price);
+                batchShards[i] = kSkipped;
+                rejected = true;
+                continue;
+            }
+            if (!journalable(updates[i].lotSize)) {
+                diagnose(DiagnosticKind::InvalidLot, "journal", updates[i].symbol, updates[i].price);
+                batchShards[i] = kSkipped;
+                rejected = true;
+                continue;
+            }
+            batchShards[i] = static_cast<std::uint32_t>(book->shard);
+            ++starts[book->shard + 1];
+        }
+        for (std::size_t shard = 0; shard < shardCount; ++shard) {
+            starts[shard + 1] += starts[shard];
+        }
+        cursor.assign(starts.begin(), starts.end() - 1);
+        for (std::size_t i = 0; i < count; ++i) {
+            if (batchShards[i] != kSkipped) {
+                grouped[cursor[batchShards[i]]++] = static_cast<std::uint32_t>(i);
+            }
+        }
+
+        constexpr std::size_t kPrefetchDistance = 4;
+        std::uint64_t lastLsn = 0;
+        std::size_t applied = 0;
+        for (std::size_t shard = 0; shard < shardCount; ++shard) {
+            const std::size_t begin = starts[shard];
+            const std::size_t end = starts[shard + 1];
+            if (begin == end) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(shards_[shard].mutex);
+            if (shards_[shard].owned.load(std::memory_order_relaxed)) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    rejectOwned(books_[updates[grouped[i]].symbol], "insert");
+                }
+                rejected = true;
+                continue;
+            }
+            for (std::size_t i = begin; i < end; ++i) {
+                if (i + kPrefetchDistance < end) {
+                    prefetch(&books_[updates[grouped[i + kPrefetchDistance]].symbol]);
+                }
+                const OrderUpdate<V>& update = updates[grouped[i]];
+                Book& book = books_[update.symbol];
+                lastLsn = std::max(lastLsn, journal(book, LogAction::Add, kNoOrderId, update.price,
+                                                    update.lotSize, update.side));
+                addToBookLocked(book, update.lotSize, update.price, update.side);
+            }
+            applied += end - begin;
+        }
+        if (refused != nullptr) {
+            *refused = count - applied;
+        }
+        // One group commit covers the whole packet
+        const Status durable = awaitDurable(lastLsn);
+        if (durable != Status::Ok) {
+            return durable;
+        }
+        return rejected ? Status::Rejected : skipped ? Status::NotFound : Status::Ok;
+    }
+
+    Status insertBatch(const std::vector<OrderUpdate<V>>& updates) {
+        return insertBatch(updates.data(), updates.size());
+    }
+
+    // Remove an order by symbol; NotFound if it has no live book
+    Status remove(const K& symbol) {
+        const Status status = clearBook(bookFor(lookup(symbol)));
+        if (status == Status::NotFound) {
+            diagnose(DiagnosticKind::SymbolNotFound, "removal", symbol);
+        }
+        return status;
+    }
+
+    // Remove all orders of an interned symbol
+    Status remove(SymbolId id) {
+        const Status status = clearBook(bookFor(id));
+        if (status == Status::NotFound) {
+            diagnose(DiagnosticKind::SymbolNotFound, "removal", id);
+        }
+        return status;
+    }
+
+    // Take lot off the level at price, unlinking the level once it reaches
+    // zero so the price range never reports an empty extreme. At most the
+    // level's remaining lot is taken; NotFound if there is no such level.
+    Status reduce(const K& symbol, int price, V lot, Side side = Side::Buy) {
+        if (!(lot > V())) {
+            diagnose(DiagnosticKind::InvalidLot, "reduce", symbol, price);
+            return Status::Rejected;
+        }
+        Book* book = bookFor(lookup(symbol));
+        const Status status = book == nullptr ? Status::NotFound : reduceBook(*book, price, lot, side);
+        if (status == Status::NotFound) {
+            diagnose(DiagnosticKind::NoSuchLevel, "reduce", symbol, price);
+        }
+        return status;
+    }
+
+    Status reduce(SymbolId id, int price, V lot, Side side = Side::Buy) {
+        if (!(lot > V())) {
+            diagnose(DiagnosticKind::InvalidLot, "reduce", id, price);
+            return Status::Rejected;
+        }
+        Book* book = bookFor(id);
+        const Status status = book == nullptr ? Status::NotFound : reduceBook(*book, price, lot, side);
+        if (status == Status::NotFound) {
+            diagnose(DiagnosticKind::NoSuchLevel, "reduce", id, price);
+        }
+        return status;
+    }
+
+    // Add an individually identified order that can later be cancelled or
+    // modified by id; Duplicate if the id is already resting, Rejected if
+    // the lot is not positive. Order-id
+    // operations go through the shard locks, so they must not be mixed with
+    // ShardActors owning the shards.
+    Status addOrder(const K& symbol, OrderId orderId, V lot, int price, Side side = Side::Buy) {
+        const SymbolId id = intern(symbol);
+        if (id == kInvalidSymbol) {
+            diagnose(DiagnosticKind::SymbolTableFull, "insert", symbol);
+            return Status::TableFull;
+        }
+        return addOrder(id, orderId, lot, price, side);
+    }
+
+    Status addOrder(SymbolId id, OrderId orderId, V lot, int price, Side side = Side::Buy) {
+        if (!(lot > V()) || !journalable(lot)) {
+            diagnoseOrder(DiagnosticKind::InvalidLot, orderId, "add");
+            return Status::Rejected;
+        }
+        Book* book = bookFor(id);
+        if (book == nullptr) {
+            diagnose(DiagnosticKind::SymbolNotFound, "insert", id);
+            return Status::NotFound;
+        }
+        std::uint64_t lsn = 0;
+        {
+            std::lock_guard<std::mutex> lock(shards_[book->shard].mutex);
+            if (ownedLocked(*book)) {
+                return rejectOwned(*book, "add an order");
+            }
+            std::lock_guard<std::mutex> orderLock(orders_.mutexFor(orderId));
+            const auto slot = static_cast<std::uint32_t>(book->orderIds.size());
+            if (!orders_.add(orderId, {id, side, price, lot, book->generation, slot})) {
+                diagnoseOrder(DiagnosticKind::DuplicateOrder, orderId);
+                return Status::Duplicate;
+            }
+            book->orderIds.push_back(orderId);
+            lsn = journal(*book, LogAction::Add, orderId, price, lot, side);
+            addToBookLocked(*book, lot, price, side);
+        }
+        return awaitDurable(lsn);
+    }
+
+    // True if orderId is resting in the order index
+    bool hasOrder(OrderId orderId) {
+        std::lock_guard<std::mutex> orderLock(orders_.mutexFor(orderId));
+        return orders_.find(orderId) != nullptr;
+    }
+
+    // Cancel a resting order, taking its lot off its level. The order's level
+    // is found through the order index, never by scanning the book.
+    Status cancel(OrderId orderId) {
+        return changeOrder(orderId, V(), "cancel");
+    }
+
+    // Change the remaining lot of a resting order; a lot of zero cancels it
+    // and a negative lot is rejected
+    Status modify(OrderId orderId, V newLot) {
+        return changeOrder(orderId, newLot, "modify");
+    }
+
+    // Publish every level change from now on to ring, or stop with nullptr.
+    // The ring must outlive the attachment.
+    void publishDeltas(L2DeltaRing* ring) {
+        deltas_.store(ring, std::memory_order_release);
+    }
+
+    // Journal every insert, order change, reduce and remove from now on, or
+    // stop with nullptr. Each call returns only once its record is durable;
+    // concurrent callers share one fdatasync per group commit. Attach before
+    // traffic starts: levels already in the map are not journaled, but the
+    // ids of interned symbols are. ShardActors cores journal what they apply
+    // and wait for each pass's group commit before counting it applied.
+    void journalTo(Journal* journal) {
+        journal_.store(journal, std::memory_order_release);
+        if (journal == nullptr) {
+            return;
+        }
+        const std::size_t count = index_.size();
+        for (std::size_t id = 0; id < count; ++id) {
+            if (books_[id].interned.load(std::memory_order_acquire)) {
+                journalSymbol(*journal, static_cast<SymbolId>(id), books_[id].symbol);
+            }
+        }
+    }
+
+    // Send diagnostics to log from now on, or discard them with nullptr.
+    // Maps start on DiagnosticLog::global(); the log must outlive the attachment.
+    void reportTo(DiagnosticLog* log) {
+        diagnostics_.store(log, std::memory_order_release);
+    }
+
+    DiagnosticLog* diagnostics() const {
+        return diagnostics_.load(std::memory_order_acquire);
+    }
+
+    // Hand a diagnostic to the attached log without blocking; failing
+    // operations also say what went wrong through their return value
+    void diagnose(const Diagnostic& event) const {
+        DiagnosticLog* log = diagnostics_.load(std::memory_order_acquire);
+        if (log != nullptr) {
+            log->report(event);
+        }
+    }
+
+    void diagnose(DiagnosticKind kind, const char* action, SymbolId id = kInvalidSymbol, int price = 0) const {
+        Diagnostic event;
+        event.kind = kind;
+        event.action = action;
+        event.symbol = id;
+        event.price = price;
+        diagnose(event);
+    }
+
+    void diagnose(DiagnosticKind kind, const char* action, const K& symbol, int price = 0) const {
+        if (diagnostics_.load(std::memory_order_relaxed) == nullptr) {
+            return;  // Skip naming the symbol
+        }
+        Diagnostic event;
+        event.kind = kind;
+        event.action = action;
+        event.price = price;
+        if constexpr (std::is_convertible<const K&, std::string_view>::value) {
+            std::string_view(symbol).copy(event.name, sizeof(event.name) - 1);
+        } else {
+            nameOf(symbol).copy(event.name, sizeof(event.name) - 1);
+        }
+        diagnose(event);
+    }
+
+    void diagnoseOrder(DiagnosticKind kind, OrderId orderId, const char* action = "") const {
+        Diagnostic event;
+        event.kind = kind;
+        event.action = action;
+        event.order = orderId;
+        diagnose(event);
+    }
+
+    // Write every live book, with its indexed orders, to a checkpoint file.
+    // Shards are captured one at a time under their lock, so writers stall
+    // only while their own shard is copied and each book, orders included,
+    // is consistent with its journal position. The file is written beside path and renamed into
+    // place once synced, so a crash never leaves a partial checkpoint.
+    bool snapshot(const std::string& path) {
+        std::vector<CheckpointBook> books;
+        std::vector<CheckpointLevel> levels;
+        std::vector<CheckpointOrder> orders;
+        std::string names;
+        const std::size_t count = index_.size();
+        Journal* journal = journal_.load(std::memory_order_acquire);
+
+        for (std::size_t shard = 0; shard < shards_.size(); ++shard) {
+            std::lock_guard<std::mutex> lock(shards_[shard].mutex);
+            // An owner writes without the lock, so its books cannot be captured
+            if (shards_[shard].owned.load(std::memory_order_relaxed)) {
+                diagnose(DiagnosticKind::ShardOwned, "checkpoint");
+                return false;
+            }
+            const std::uint64_t lsn = journal == nullptr ? 0 : journal->appended();
+            for (std::size_t id = 0; id < count; ++id) {
+                const Book& book = books_[id];
+                if (!book.interned.load(std::memory_order_acquire) || book.shard != shard ||
+                    !book.live.load(std::memory_order_relaxed)) {
+                    continue;
+                }
+                const std::string name = nameOf(book.symbol);
+                CheckpointBook entry{};
+                entry.nameOffset = names.size();
+                entry.nameLength = static_cast<std::uint32_t>(name.size());
+                names += name;
+                entry.journalLsn = lsn;
+                entry.firstLevel = levels.size();
+                entry.firstOrder = orders.size();
+                entry.orderCount = static_cast<std::uint32_t>(book.orderIds.size());
+                entry.bidCount = static_cast<std::uint32_t>(book.bids.depth());
+                entry.askCount = static_cast<std::uint32_t>(book.asks.depth());
+                for (const PriceLadder<V, Alloc>* ladder : {&book.bids, &book.asks}) {
+                    ladder->forEach([&levels](const PriceLevel<V>& level) {
+                        levels.push_back({level.price, 0,
+                                          static_cast<std::int64_t>(level.lotSize.load(std::memory_order_relaxed))});
+                    });
+                }
+                // A book's orders only change under its shard lock
+                for (OrderId orderId : book.orderIds) {
+                    std::lock_guard<std::mutex> orderLock(orders_.mutexFor(orderId));
+                    const OrderLocation<V>& order = *orders_.find(orderId);
+                    orders.push_back({orderId, order.price, order.side, {}, static_cast<std::int64_t>(order.lot)});
+                }
+                books.push_back(entry);
+            }
+        }
+
+        const std::string temporary = path + ".tmp";
+        const int fd = ::open(temporary.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+        const CheckpointHeader header{kCheckpointMagic, kCheckpointVersion, static_cast<std::uint32_t>(books.size()),
+                                      levels.size(), orders.size(), names.size()};
+        auto put = [fd](const void* data, std::size_t bytes) {
+            return writeFully(fd, data, bytes);
+        };
+        const bool ok = fd >= 0 && put(&header, sizeof(header)) &&
+                        put(books.data(), books.size() * sizeof(CheckpointBook)) &&
+                        put(levels.data(), levels.size() * sizeof(CheckpointLevel)) &&
+                        put(orders.data(), orders.size() * sizeof(CheckpointOrder)) &&
+                        put(names.data(), names.size()) &&
+                        fsync(fd) == 0;
+        if (fd >= 0) {
+            close(fd);
+        }
+        if (!ok || std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::cerr << "Error: Cannot write checkpoint " << path << "." << std::endl;
+            std::remove(temporary.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    // Rebuild books from a checkpoint written by snapshot(). The file is
+    // mapped and its books are rebuilt on threads that each own a subset of
+    // the shards, so restart cost follows the checkpoint's size. Meant for a
+    // map that is not yet taking traffic; replay the journal afterwards with
+    // recoverJournal to apply what happened after the checkpoint. Fails if
+    // a shard actor owns any of the books or the symbol table cannot hold
+    // them all.
+    bool load(const std::string& path, std::size_t threads = 4) {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (fd < 0 || fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(CheckpointHeader)) {
+            std::cerr << "Error: Cannot open checkpoint " << path << "." << std::endl;
+            if (fd >= 0) {
+                close(fd);
+            }
+            return false;
+        }
+        const std::size_t bytes = static_cast<std::size_t>(info.st_size);
+        void* base = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            std::cerr << "Error: Cannot map checkpoint " << path << "." << std::endl;
+            return false;
+        }
+        const CheckpointHeader& header = *static_cast<const CheckpointHeader*>(base);
+        if (!validCheckpoint(header, bytes)) {
+            std::cerr << "Error: " << path << " is not a valid checkpoint." << std::endl;
+            munmap(base, bytes);
+            return false;
+        }
+        const char* cursor = static_cast<const char*>(base) + sizeof(CheckpointHeader);
+        const auto* books = reinterpret_cast<const CheckpointBook*>(cursor);
+        const auto* levels = reinterpret_cast<const CheckpointLevel*>(cursor + header.bookCount * sizeof(CheckpointBook));
+        const auto* orders = reinterpret_cast<const CheckpointOrder*>(
+            reinterpret_cast<const char*>(levels) + header.levelCount * sizeof(CheckpointLevel));
+        const char* names = reinterpret_cast<const char*>(orders) + header.orderCount * sizeof(CheckpointOrder);
+        // Every book's slices must lie inside the file before any is rebuilt
+        for (std::size_t i = 0; i < header.bookCount; ++i) {
+            const CheckpointBook& book = books[i];
+            bool valid = book.firstLevel <= header.levelCount &&
+                         std::uint64_t(book.bidCount) + book.askCount <= header.levelCount - book.firstLevel &&
+                         book.firstOrder <= header.orderCount &&
+                         book.orderCount <= header.orderCount - book.firstOrder &&
+                         book.nameOffset <= header.nameBytes &&
+                         book.nameLength <= header.nameBytes - book.nameOffset;
+            for (std::uint64_t n = 0; valid && n < book.orderCount; ++n) {
+                valid = orders[book.firstOrder + n].side <= Side::Sell;
+            }
+            if (!valid) {
+                std::cerr << "Error: " << path << " is not a valid checkpoint." << std::endl;
+                munmap(base, bytes);
+                return false;
+            }
+        }
+
+        std::vector<SymbolId> ids(header.bookCount);
+        for (std::size_t i = 0; i < ids.size(); ++i) {
+            ids[i] = intern(K(std::string(names + books[i].nameOffset, books[i].nameLength)));
+            // A book with no id would be dropped, so the load cannot succeed
+            if (ids[i] == kInvalidSymbol) {
+                std::cerr << "Error: Symbol table is full loading checkpoint " << path << "." << std::endl;
+                munmap(base, bytes);
+                return false;
+            }
+        }
+        threads = std::max<std::size_t>(1, threads);
+        std::atomic<bool> refused{false};
+        auto rebuild = [&](std::size_t thread) {
+            for (std::size_t i = 0; i < ids.size(); ++i) {
+                Book* book = bookFor(ids[i]);
+                if (book == nullptr || book->shard % threads != thread) {
+                    continue;
+                }
+                if (restoreBook(*book, ids[i], books[i], levels, orders) != Status::Ok) {
+                    refused.store(true, std::memory_order_relaxed);
+                }
+            }
+        };
+        std::vector<std::thread> workers;
+        for (std::size_t t = 1; t < threads; ++t) {
+            workers.emplace_back(rebuild, t);
+        }
+        rebuild(0);
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        munmap(base, bytes);
+        return !refused.load(std::memory_order_relaxed);
+    }
+
+    // True if a checkpoint's counts fit in bytes; checked by division so a
+    // corrupt header cannot overflow
+    static bool validCheckpoint(const CheckpointHeader& header, std::size_t bytes) {
+        if (header.magic != kCheckpointMagic || header.version != kCheckpointVersion) {
+            return false;
+        }
+        std::size_t left = bytes - sizeof(CheckpointHeader);
+        if (header.bookCount > left / sizeof(CheckpointBook)) {
+            return false;
+        }
+        left -= header.bookCount * sizeof(CheckpointBook);
+        if (header.levelCount > left / sizeof(CheckpointLevel)) {
+            return false;
+        }
+        left -= header.levelCount * sizeof(CheckpointLevel);
+        if (header.orderCount > left / sizeof(CheckpointOrder)) {
+            return false;
+        }
+        left -= header.orderCount * sizeof(CheckpointOrder);
+        return header.nameBytes <= left;
+    }
+
+    // Journal position a book was loaded at, 0 if it was not loaded
+    std::uint64_t restoredLsn(SymbolId id) const {
+        const Book* book = bookFor(id);
+        return book == nullptr ? 0 : book->restoredLsn;
+    }
+
+    // Store a symbol's levels in tick-indexed windows of windowTicks slots,
+    // one per side, around referencePrice instead of trees. Prices off the tick grid or
+    // outside the window fall back to the tree, and the window recentres as
+    // prices drift. Meant to be chosen per symbol at session start.
+    Status useTickLadder(SymbolId id, int referencePrice, int tickSize, std::size_t windowTicks = 1024) {
+        Book* book = bookFor(id);
+        if (book == nullptr) {
+            diagnose(DiagnosticKind::SymbolNotFound, "tick ladder", id);
+            return Status::NotFound;
+        }
+        std::lock_guard<std::mutex> lock(shards_[book->shard].mutex);
+        if (ownedLocked(*book)) {
+            return rejectOwned(*book, "configure");
+        }
+        book->bids.useTickWindow(referencePrice, tickSize, windowTicks);
+        book->asks.useTickWindow(referencePrice, tickSize, windowTicks);
+        book->publishSummary(book->live.load(std::memory_order_relaxed), V());
+        return Status::Ok;
+    }
+
+    Status useTickLadder(const K& symbol, int referencePrice, int tickSize, std::size_t windowTicks = 1024) {
+        const SymbolId id = intern(symbol);
+        if (id == kInvalidSymbol) {
+            diagnose(DiagnosticKind::SymbolTableFull, "configure", symbol);
+            return Status::TableFull;
+        }
+        return useTickLadder(id, referencePrice, tickSize, windowTicks);
+    }
+
+    // End-of-day release of every book. With an allocator that reclaims
+    // wholesale (an ArenaAllocator with an arena) each ladder is dropped in
+    // O(1) instead of freeing its levels one at a time; release the arena
+    // afterwards.
+    // Books owned by a shard actor are left alone and make it return Rejected.
+    Status releaseBooks() {
+        Status result = Status::Ok;
+        const std::size_t count = index_.size();
+        for (std::size_t id = 0; id < count; ++id) {
+            Book& book = books_[id];
+            if (!book.interned.load(std::memory_order_acquire)) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(shards_[book.shard].mutex);
+            if (ownedLocked(book)) {
+                result = rejectOwned(book, "release");
+                continue;
+            }
+            forgetOrders(book);
+            if (book.bids.releasesWholesale() && book.asks.releasesWholesale()) {
+                book.bids.abandon();
+                book.asks.abandon();
+                ++book.generation;
+            } else {
+                book.clearLevels();
+            }
+            book.publishSummary(false, V());
+            emitClear(book);
+        }
+        return result;
+    }
+
+    // Asynchronous variants that run the operation on a pool worker
+    std::future<void> insertAsync(WorkStealingPool& pool, const K& symbol, V lot, int price) {
+        return pool.submit([this, symbol, lot, price]() {
+            insert(symbol, lot, price);
+        });
+    }
+
+    std::future<void> removeAsync(WorkStealingPool& pool, const K& symbol) {
+        return pool.submit([this, symbol]() {
+            remove(symbol);
+        });
+    }
+
+    std::future<std::optional<std::pair<int, int>>> getPriceRangeAsync(WorkStealingPool& pool, const K& symbol) const {
+        return pool.submit([this, symbol]() {
+            return getPriceRange(symbol);
+        });
+    }
+
+    // Display all orders in symbol id order. Books are rendered from their
+    // snapshots, with no lock held, into a reused buffer that is then handed
+    // to the output in one piece: a single write() for a file descriptor.
+    void display() const {
+        std::cout.flush();  // Keep earlier iostream output ahead of ours
+        display(STDOUT_FILENO);
+    }
+
+    void display(int fd) const {
+        const FormatBuffer& text = render();
+        if (!writeFully(fd, text.data(), text.size())) {
+            diagnose(DiagnosticKind::WriteFailed, "display output");
+        }
+    }
+
+    void display(std::ostream& out) const {
+        const FormatBuffer& text = render();
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+
+    // Visit every live book as an immutable snapshot, in symbol id order.
+    // A book is copied under its shard lock only if it changed since its last
+    // snapshot; the walk itself runs under an epoch guard with no locks held.
+    template <typename F>
+    void forEachBook(F&& fn) const {
+        {
+            EpochDomain::Guard guard(epochs_);
+            const std::size_t count = index_.size();
+            for (std::size_t id = 0; id < count; ++id) {
+                const Book& book = books_[id];
+                if (!book.interned.load(std::memory_order_acquire) ||
+                    !book.live.load(std::memory_order_relaxed)) {
+                    continue;
+                }
+                const BookSnapshot<V>* snapshot = snapshotOf(book);
+                if (snapshot != nullptr && snapshot->live) {
+                    fn(book.symbol, *snapshot);
+                }
+            }
+        }
+        epochs_.reclaim();
+    }
+
+    // Get the lowest and highest price for a given symbol, or nothing if it
+    // has no live book. Constant time and lock-free: the range is read
+    // optimistically under the book's seqlock.
+    std::optional<std::pair<int, int>> getPriceRange(const K& symbol) const {
+        const Book* book = bookFor(lookup(symbol));
+        const BookSummary<V> summary = book == nullptr ? BookSummary<V>() : book->readSummary();
+        if (!summary.live) {
+            diagnose(DiagnosticKind::SymbolNotFound, "price range", symbol);
+            return std::nullopt;
+        }
+        return rangeOf(summary);
+    }
+
+    // Get the lowest and highest price for an interned symbol
+    std::optional<std::pair<int, int>> getPriceRange(SymbolId id) const {
+        const Book* book = bookFor(id);
+        const BookSummary<V> summary = book == nullptr ? BookSummary<V>() : book->readSummary();
+        if (!summary.live) {
+            diagnose(DiagnosticKind::SymbolNotFound, "price range", id);
+            return std::nullopt;
+        }
+        return rangeOf(summary);
+    }
+
+    // Get range, depth and total lot of a symbol as one consistent snapshot,
+    // without taking any lock; live is false if the symbol has no book
+    BookSummary<V> getSummary(const K& symbol) const {
+        const Book* book = bookFor(lookup(symbol));
+        return book == nullptr ? BookSummary<V>() : book->readSummary();
+    }
+
+    BookSummary<V> getSummary(SymbolId id) const {
+        const Book* book = bookFor(id);
+        return book == nullptr ? BookSummary<V>() : book->readSummary();
+    }
+
+    // Best bid and offer with their lots, read lock-free under the book's
+    // seqlock. Both are maintained on every insert, so this is O(1) and safe
+    // to poll per tick; live is false if the symbol has no book.
+    TopOfBook<V> getTopOfBook(const K& symbol) const {
+        const Book* book = bookFor(lookup(symbol));
+        return book == nullptr ? TopOfBook<V>() : book->readTop();
+    }
+
+    TopOfBook<V> getTopOfBook(SymbolId id) const {
+        const Book* book = bookFor(id);
+        return book == nullptr ? TopOfBook<V>() : book->readTop();
+    }
+
+    // Test functions for validation
+    void test() {
+        assert(testInsert());
+        assert(testRemove());
+        assert(testDisplay());
+        assert(testPriceRange());
+        assert(testLadderOrder());
+        assert(testInterning());
+        assert(testInsertBatch());
+        assert(testSummary());
+        assert(testConcurrentSummary());
+        assert(testSnapshots());
+        assert(testAsync());
+        assert(testShardActors());
+        assert(testIngress());
+        assert(testArena());
+        assert(testTickLadder());
+        assert(testTopOfBook());
+        assert(testOrderIds());
+        assert(testReduce());
+        assert(testMatching());
+        assert(testDeltaRing());
+        assert(testOrderLog());
+        assert(testJournal());
+        assert(testJournalFailure());
+        assert(testCheckpoint());
+        assert(testDisplayFormat());
+        assert(testDiagnostics());
+    }
+
+private:
+    // Format every live book into this thread's display buffer
+    const FormatBuffer& render() const {
+        static thread_local FormatBuffer text;
+        text.clear();
+        forEachBook([](const K& symbol, const BookSnapshot<V>& snapshot) {
+            text.appendValue(symbol);
+            text.append(": ");
+            appendLevels(text, snapshot.bids);
+            if (!snapshot.asks.empty()) {
+                text.append("| asks: ");
+                appendLevels(text, snapshot.asks);
+            }
+            text.append("\n");
+        });
+        return text;
+    }
+
+    static void appendLevels(FormatBuffer& text, const std::vector<SnapshotLevel<V>>& levels) {
+        for (const auto& level : levels) {
+            text.append("{lotSize: ");
+            text.appendValue(level.lotSize);
+            text.append(", price: ");
+            text.appendNumber(level.price);
+            text.append("} ");
+        }
+    }
+
+    static std::pair<int, int> rangeOf(const BookSummary<V>& summary) {
+        if (summary.depth == 0) {
+            return {0, 0};
+        }
+        return {summary.lowPrice, summary.highPrice};
+    }
+
+    // Per-symbol order book, stored contiguously and indexed by SymbolId.
+    // symbol and shard are written once when the id is interned; the ladders
+    // are guarded by the shard lock. The summary fields are written only by
+    // the lock holder and read lock-free through the per-book seqlock.
+    struct Book {
+        K symbol;
+        std::size_t shard = 0;
+        std::atomic<bool> interned{false};
+        PriceLadder<V, Alloc> bids;
+        PriceLadder<V, Alloc> asks;
+        // Bumped whenever the book is cleared, invalidating its indexed orders
+        std::uint32_t generation = 0;
+        // Ids of the indexed orders resting in this generation of the book
+        std::vector<OrderId> orderIds;
+        // Last journal record reflected by the checkpoint the book was loaded from
+        std::uint64_t restoredLsn = 0;
+
+        // Sequence lock: odd while a writer is updating the summary, so
+        // readers retry rather than ever blocking a writer
+        std::atomic<std::uint32_t> seq{0};
+        std::atomic<bool> live{false};
+        std::atomic<int> lowPrice{0};
+        std::atomic<int> highPrice{0};
+        std::atomic<std::size_t> depth{0};
+        std::atomic<V> totalLot{V()};
+        std::atomic<bool> hasBid{false};
+        std::atomic<bool> hasAsk{false};
+        std::atomic<int> bidPrice{0};
+        std::atomic<V> bidLot{V()};
+        std::atomic<int> askPrice{0};
+        std::atomic<V> askLot{V()};
+
+        // Latest published snapshot; replaced copies are retired to epochs_
+        mutable std::atomic<const BookSnapshot<V>*> snapshot{nullptr};
+
+        Book() = default;
+        Book(const Book& other) = delete;
+        Book& operator=(const Book& other) = delete;
+
+        ~Book() {
+            delete snapshot.load();
+        }
+
+        PriceLadder<V, Alloc>& ladder(Side side) {
+            return side == Side::Buy ? bids : asks;
+        }
+
+        const PriceLadder<V, Alloc>& ladder(Side side) const {
+            return side == Side::Buy ? bids : asks;
+        }
+
+        void clearLevels() {
+            bids.clear();
+            asks.clear();
+            orderIds.clear();
+            ++generation;
+        }
+
+        // Republish the summary after a ladder change; the ladders keep their
+        // extremes at hand so this is O(1)
+        void publishSummary(bool isLive, V lotDelta) {
+            const std::uint32_t sequence = seq.load(std::memory_order_relaxed);
+            seq.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            live.store(isLive, std::memory_order_relaxed);
+            if (!bids.empty() || !asks.empty()) {
+                const int low = bids.empty() ? asks.lowest().price
+                              : asks.empty() ? bids.lowest().price
+                              : std::min(bids.lowest().price, asks.lowest().price);
+                const int high = bids.empty() ? asks.highest().price
+                               : asks.empty() ? bids.highest().price
+                               : std::max(bids.highest().price, asks.highest().price);
+                lowPrice.store(low, std::memory_order_relaxed);
+                highPrice.store(high, std::memory_order_relaxed);
+            }
+            depth.store(bids.depth() + asks.depth(), std::memory_order_relaxed);
+            totalLot.store(isLive ? totalLot.load(std::memory_order_relaxed) + lotDelta : V(),
+                           std::memory_order_relaxed);
+
+            // Best bid is the highest buy level, best offer the lowest sell level
+            hasBid.store(!bids.empty(), std::memory_order_relaxed);
+            if (!bids.empty()) {
+                bidPrice.store(bids.highest().price, std::memory_order_relaxed);
+                bidLot.store(bids.highest().lotSize.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+            hasAsk.store(!asks.empty(), std::memory_order_relaxed);
+            if (!asks.empty()) {
+                askPrice.store(asks.lowest().price, std::memory_order_relaxed);
+                askLot.store(asks.lowest().lotSize.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            }
+
+            seq.store(sequence + 2, std::memory_order_release);
+        }
+
+        // Run read under the seqlock until it observes a consistent summary
+        template <typename F>
+        void readConsistent(F&& read) const {
+            for (unsigned attempt = 0;; ++attempt) {
+                const std::uint32_t before = seq.load(std::memory_order_acquire);
+                if ((before & 1) == 0) {
+                    read();
+                    std::atomic_thread_fence(std::memory_order_acquire);
+                    if (seq.load(std::memory_order_relaxed) == before) {
+                        return;
+                    }
+                }
+                // A writer raced us; back off if it keeps the book busy
+                if (attempt >= 64) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        BookSummary<V> readSummary() const {
+            BookSummary<V> summary;
+            readConsistent([this, &summary]() {
+                summary.live = live.load(std::memory_order_relaxed);
+                summary.lowPrice = lowPrice.load(std::memory_order_relaxed);
+                summary.highPrice = highPrice.load(std::memory_order_relaxed);
+                summary.depth = depth.load(std::memory_order_relaxed);
+                summary.totalLot = totalLot.load(std::memory_order_relaxed);
+            });
+            return summary;
+        }
+
+        TopOfBook<V> readTop() const {
+            TopOfBook<V> top;
+            readConsistent([this, &top]() {
+                top.live = live.load(std::memory_order_relaxed);
+                top.hasBid = hasBid.load(std::memory_order_relaxed);
+                top.hasAsk = hasAsk.load(std::memory_order_relaxed);
+                top.bidPrice = bidPrice.load(std::memory_order_relaxed);
+                top.bidLot = bidLot.load(std::memory_order_relaxed);
+                top.askPrice = askPrice.load(std::memory_order_relaxed);
+                top.askLot = askLot.load(std::memory_order_relaxed);
+            });
+            if (!top.hasBid) {
+                top.bidPrice = 0;
+                top.bidLot = V();
+            }
+            if (!top.hasAsk) {
+                top.askPrice = 0;
+                top.askLot = V();
+            }
+            return top;
+        }
+    };
+
+    // One independently locked stripe; aligned so neighbouring shard locks
+    // do not share a cache line
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        // Set while a ShardActors core is the shard's single writer
+        std::atomic<bool> owned{false};
+    };
+
+    std::vector<Shard> shards_;
+    SymbolTable<K> index_;
+    std::unique_ptr<Book[]> books_;
+    OrderIndex<V> orders_;
+    std::atomic<L2DeltaRing*> deltas_{nullptr};
+    std::atomic<Journal*> journal_{nullptr};
+    std::atomic<DiagnosticLog*> diagnostics_{&DiagnosticLog::global()};
+    mutable EpochDomain epochs_;
+
+    static std::size_t hashOf(const K& symbol) {
+        return std::hash<K>{}(symbol);
+    }
+
+    // Map an id to its book, or nullptr if the id was never interned
+    Book* bookFor(SymbolId id) {
+        if (id >= index_.capacity() || !books_[id].interned.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &books_[id];
+    }
+
+    const Book* bookFor(SymbolId id) const {
+        return const_cast<ConcurrentHashMap*>(this)->bookFor(id);
+    }
+
+    // True while a ShardActors core is the book's only writer. The caller
+    // holds the shard lock, which setShardsOwned cycles, so the answer holds
+    // until the lock is released.
+    bool ownedLocked(const Book& book) const {
+        return shards_[book.shard].owned.load(std::memory_order_relaxed);
+    }
+
+    Status rejectOwned(const Book& book, const char* action) const {
+        diagnose(DiagnosticKind::ShardOwned, action, idOf(book));
+        return Status::Rejected;
+    }
+
+    Status addToBook(Book& book, V lot, int price, Side side) {
+        // A level with no lot would linger as a stale extreme
+        if (!(lot > V())) {
+            diagnose(DiagnosticKind::InvalidLot, "insert", idOf(book), price);
+            return Status::Rejected;
+        }
+        if (!journalable(lot)) {
+            diagnose(DiagnosticKind::InvalidLot, "journal", idOf(book), price);
+            return Status::Rejected;
+        }
+        std::uint64_t lsn = 0;
+        {
+            std::lock_guard<std::mutex> lock(shards_[book.shard].mutex);
+            if (ownedLocked(book)) {
+                return rejectOwned(book, "insert");
+            }
+            lsn = journal(book, LogAction::Add, kNoOrderId, price, lot, side);
+            addToBookLocked(book, lot, price, side);
+        }
+        return awaitDurable(lsn);
+    }
+
+    // The caller holds the book's shard lock
+    void addToBookLocked(Book& book, V lot, int price, Side side) {
+        book.ladder(side).add(price, lot);
+        book.publishSummary(true, lot);
+        emitLevel(book, side, price);
+    }
+
+    // Replace a book's contents with one checkpoint entry; Rejected, leaving
+    // the book untouched, if a shard actor owns it
+    Status restoreBook(Book& book, SymbolId id, const CheckpointBook& entry, const CheckpointLevel* levels,
+                       const CheckpointOrder* orders) {
+        std::lock_guard<std::mutex> lock(shards_[book.shard].mutex);
+        if (ownedLocked(book)) {
+            return rejectOwned(book, "restore");
+        }
+        forgetOrders(book);
+        book.clearLevels();
+        book.publishSummary(false, V());
+        V total = V();
+        for (std::uint64_t n = 0; n < entry.bidCount + entry.askCount; ++n) {
+            const CheckpointLevel& level = levels[entry.firstLevel + n];
+            (n < entry.bidCount ? book.bids : book.asks).add(level.price, static_cast<V>(level.lot));
+            total += static_cast<V>(level.lot);
+        }
+        for (std::uint64_t n = 0; n < entry.orderCount; ++n) {
+            const CheckpointOrder& order = orders[entry.firstOrder + n];
+            std::lock_guard<std::mutex> orderLock(orders_.mutexFor(order.orderId));
+            const auto slot = static_cast<std::uint32_t>(book.orderIds.size());
+            if (orders_.add(order.orderId, {id, order.side, order.price, static_cast<V>(order.lot),
+                                            book.generation, slot})) {
+                book.orderIds.push_back(order.orderId);
+            }
+        }
+        book.restoredLsn = entry.journalLsn;
+        book.publishSummary(true, total);
+        return Status::Ok;
+    }
+
+    SymbolId idOf(const Book& book) const {
+        return static_cast<SymbolId>(&book - books_.get());
+    }
+
+    static std::string nameOf(const K& symbol) {
+        std::ostringstream name;
+        name << symbol;
+        return name.str();
+    }
+
+    static void journalSymbol(Journal& journal, SymbolId id, const K& symbol) {
+        packSymbolName(id, nameOf(symbol), [&journal](const OrderLogRecord& record) {
+            journal.append(record);
+        });
+    }
+
+    // False if a journal is attached and lot would not survive its 32-bit
+    // lot field unchanged; such changes are refused rather than journaled
+    // wrongly
+    bool journalable(V lot) const {
+        if (journal_.load(std::memory_order_acquire) == nullptr) {
+            return true;
+        }
+        if (!(lot >= static_cast<V>(std::numeric_limits<std::int32_t>::min()) &&
+              lot <= static_cast<V>(std::numeric_limits<std::int32_t>::max()))) {
+            return false;
+        }
+        return static_cast<V>(static_cast<std::int32_t>(lot)) == lot;
+    }
+
+    // Append a mutation to the journal, if one is attached, and return its
+    // sequence number, or 0. Called by the book's only writer, its shard
+    // lock holder or owner, so each symbol's records are journaled in the
+    // order they are applied.
+    std::uint64_t journal(const Book& book, LogAction action, OrderId orderId, int price, V lot, Side side) {
+        Journal* journal = journal_.load(std::memory_order_acquire);
+        if (journal == nullptr) {
+            return 0;
+        }
+        OrderLogRecord record{};
+        record.orderId = orderId;
+        record.symbol = idOf(book);
+        record.price = price;
+        record.lot = static_cast<std::int32_t>(lot);
+        record.action = action;
+        record.side = side;
+        return journal->append(record);
+    }
+
+    // Wait for the group commit covering lsn; called with no lock held.
+    // A failed journal refuses appends, so lsn 0 with a journal attached
+    // still reports the failure.
+    Status awaitDurable(std::uint64_t lsn) const {
+        Journal* journal = journal_.load(std::memory_order_acquire);
+        if (journal == nullptr || journal->commit(lsn)) {
+            return Status::Ok;
+        }
+        diagnose(DiagnosticKind::WriteFailed, "journal");
+        return Status::WriteFailed;
+    }
+
+    // Publish a level's new aggregate lot. The caller is the book's only
+    // writer, so each symbol's deltas enter the ring in order.
+    void emitLevel(const Book& book, Side side, int price) {
+        L2DeltaRing* ring = deltas_.load(std::memory_order_acquire);
+        if (ring == nullptr) {
+            return;
+        }
+        const PriceLevel<V>* level = book.ladder(side).find(price);
+        const std::int64_t lot = level == nullptr ? 0 : static_cast<std::int64_t>(level->lotSize.load(std::memory_order_relaxed));
+        ring->publish(idOf(book), side, DeltaKind::Level, price, lot);
+    }
+
+    void emitClear(const Book& book) {
+        L2DeltaRing* ring = deltas_.load(std::memory_order_acquire);
+        if (ring != nullptr) {
+            ring->publish(idOf(book), Side::Buy, DeltaKind::Clear, 0, 0);
+        }
+    }
+
+    Status reduceBook(Book& book, int price, V lot, Side side) {
+        if (!journalable(lot)) {
+            diagnose(DiagnosticKind::InvalidLot, "journal", idOf(book), price);
+            return Status::Rejected;
+        }
+        std::uint64_t lsn = 0;
+        {
+            std::lock_guard<std::mutex> lock(shards_[book.shard].mutex);
+            if (ownedLocked(book)) {
+                return rejectOwned(book, "reduce");
+            }
+            if (book.ladder(side).find(price) == nullptr) {
+                return Status::NotFound;
+            }
+            lsn = journal(book, LogAction::Reduce, kNoOrderId, price, lot, side);
+            reduceBookLocked(book, price, lot, side);
+        }
+        return awaitDurable(lsn);
+    }
+
+    // The caller holds the book's shard lock
+    bool reduceBookLocked(Book& book, int price, V lot, Side side) {
+        V taken = V();
+        if (!book.ladder(side).reduce(price, lot, taken)) {
+            return false;
+        }
+        book.publishSummary(book.live.load(std::memory_order_relaxed), -taken);
+        emitLevel(book, side, price);
+        return true;
+    }
+
+    // Erase a book's orders from the order index so their ids can be used
+    // again. The caller holds the book's shard lock.
+    void forgetOrders(Book& book) {
+        for (const OrderId orderId : book.orderIds) {
+            std::lock_guard<std::mutex> orderLock(orders_.mutexFor(orderId));
+            orders_.erase(orderId);
+        }
+        book.orderIds.clear();
+    }
+
+    // Swap-remove the order id at slot from a book's order list. The caller
+    // holds the shard lock, which guards every bookSlot of the book's orders.
+    void unlinkOrder(Book& book, std::uint32_t slot) {
+        const OrderId moved = book.orderIds.back();
+        book.orderIds[slot] = moved;
+        book.orderIds.pop_back();
+        if (slot < book.orderIds.size()) {
+            std::lock_guard<std::mutex> orderLock(orders_.mutexFor(moved));
+            orders_.find(moved)->bookSlot = slot;
+        }
+    }
+
+    // Apply a cancel (newLot of zero) or modify to an indexed order. The
+    // order's symbol never changes, so it is read first to find the shard;
+    // the entry is then re-checked with the shard lock held, which is always
+    // taken before the order stripe lock.
+    Status changeOrder(OrderId orderId, V newLot, const char* action) {
+        if (newLot < V() || !journalable(newLot)) {
+            diagnoseOrder(DiagnosticKind::InvalidLot, orderId, action);
+            return Status::Rejected;
+        }
+        Book* book = nullptr;
+        {
+            std::lock_guard<std::mutex> orderLock(orders_.mutexFor(orderId));
+            const OrderLocation<V>* order = orders_.find(orderId);
+            if (order != nullptr) {
+                book = bookFor(order->symbol);
+            }
+        }
+        if (book == nullptr) {
+            diagnoseOrder(DiagnosticKind::OrderNotFound, orderId, action);
+            return Status::NotFound;
+        }
+
+        std::unique_lock<std::mutex> lock(shards_[book->shard].mutex);
+        if (ownedLocked(*book)) {
+            return rejectOwned(*book, action);
+        }
+        std::unique_lock<std::mutex> orderLock(orders_.mutexFor(orderId));
+        OrderLocation<V>* order = orders_.find(orderId);
+        if (order == nullptr || order->generation != book->generation) {
+            // Cancelled meanwhile, or its book was removed since it was placed
+            if (order != nullptr) {
+                orders_.erase(orderId);
+            }
+            diagnoseOrder(DiagnosticKind::OrderNotFound, orderId, action);
+            return Status::NotFound;
+        }
+        const std::uint64_t lsn = journal(*book, newLot == V() ? LogAction::Cancel : LogAction::Modify,
+                                          orderId, order->price, newLot, order->side);
+        if (newLot < order->lot) {
+            // The level may already be gone if anonymous reduces emptied it
+            reduceBookLocked(*book, order->price, order->lot - newLot, order->side);
+        } else if (newLot > order->lot) {
+            addToBookLocked(*book, newLot - order->lot, order->price, order->side);
+        }
+        if (newLot == V()) {
+            const std::uint32_t slot = order->bookSlot;
+            orders_.erase(orderId);
+            orderLock.unlock();
+            unlinkOrder(*book, slot);
+        } else {
+            order->lot = newLot;
+            orderLock.unlock();
+        }
+        lock.unlock();
+        return awaitDurable(lsn);
+    }
+
+    // Return an up-to-date snapshot of a book. The caller must hold an epoch
+    // guard for as long as it uses the result.
+    // Owned books are only ever read through the snapshot their owner last
+    // published, which may be nullptr before its first refresh.
+    const BookSnapshot<V>* snapshotOf(const Book& book) const {
+        const BookSnapshot<V>* current = book.snapshot.load();
+        if (shards_[book.shard].owned.load(std::memory_order_acquire) ||
+            (current != nullptr && current->sequence == book.seq.load(std::memory_order_acquire))) {
+            return current;
+        }
+        std::lock_guard<std::mutex> lock(shards_[book.shard].mutex);
+        // An owner may have taken the shard since the check above; it now
+        // writes without the lock, so only its own snapshots are safe to use
+        if (shards_[book.shard].owned.load(std::memory_order_acquire)) {
+            return book.snapshot.load();
+        }
+        return captureSnapshot(book);
+    }
+
+    // Copy the ladder into a new published snapshot. The caller must be the
+    // book's only writer for the duration: its shard lock holder or owner.
+    const BookSnapshot<V>* captureSnapshot(const Book& book) const {
+        auto fresh = new BookSnapshot<V>();
+        fresh->sequence = book.seq.load(std::memory_order_relaxed);
+        fresh->live = book.live.load(std::memory_order_relaxed);
+        fresh->bids.reserve(book.bids.depth());
+        book.bids.forEach([fresh](const PriceLevel<V>& level) {
+            fresh->bids.push_back({level.price, level.lotSize.load(std::memory_order_relaxed)});
+        });
+        fresh->asks.reserve(book.asks.depth());
+        book.asks.forEach([fresh](const PriceLevel<V>& level) {
+            fresh->asks.push_back({level.price, level.lotSize.load(std::memory_order_relaxed)});
+        });
+
+        const BookSnapshot<V>* previous = book.snapshot.exchange(fresh);
+        if (previous != nullptr) {
+            epochs_.retire(previous);
+        }
+        return fresh;
+    }
+
+    // Single-writer entry points used by ShardActors; the calling core owns
+    // the book's shard, so no lock is taken
+    template <typename, typename, typename>
+    friend class ShardActors;
+
+    void setShardsOwned(bool owned) {
+        for (auto& shard : shards_) {
+            // Cycle the lock so no locked writer is mid-update at the handover
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.owned.store(owned, std::memory_order_release);
+        }
+    }
+
+    // The owner journals as it applies, keeping each book's records in
+    // order; both return the record's sequence number, or 0 if none
+    std::uint64_t applyOwnedInsert(SymbolId id, V lot, int price, Side side) {
+        Book* book = bookFor(id);
+        if (book == nullptr) {
+            diagnose(DiagnosticKind::SymbolNotFound, "insert", id);
+            return 0;
+        }
+        if (!(lot > V()) || !journalable(lot)) {
+            diagnose(DiagnosticKind::InvalidLot, "insert", id, price);
+            return 0;
+        }
+        const std::uint64_t lsn = journal(*book, LogAction::Add, kNoOrderId, price, lot, side);
+        addToBookLocked(*book, lot, price, side);
+        return lsn;
+    }
+
+    std::uint64_t applyOwnedRemove(SymbolId id) {
+        Book* book = bookFor(id);
+        if (book == nullptr || !book->live.load(std::memory_order_relaxed)) {
+            diagnose(DiagnosticKind::SymbolNotFound, "removal", id);
+            return 0;
+        }
+        const std::uint64_t lsn = journal(*book, LogAction::Remove, kNoOrderId, 0, V(), Side::Buy);
+        forgetOrders(*book);
+        book->clearLevels();
+        book->publishSummary(false, V());
+        emitClear(*book);
+        return lsn;
+    }
+
+    void publishOwnedSnapshot(SymbolId id) {
+        const Book* book = bookFor(id);
+        const BookSnapshot<V>* current = book->snapshot.load();
+        if (current == nullptr || current->sequence != book->seq.load(std::memory_order_relaxed)) {
+            captureSnapshot(*book);
+        }
+    }
+
+    static void prefetch(const void* address) {
+#if defined(__GNUC__)
+        __builtin_prefetch(address, 1);
+#else
+        (void)address;
+#endif
+    }
+
+    // Drop every level of a book; NotFound if the book is not live.
+    // The id stays interned so the symbol can be re-used later in the day.
+    Status clearBook(Book* book) {
+        if (book == nullptr) {
+            return Status::NotFound;
+        }
+        std::uint64_t lsn = 0;
+        {
+            std::lock_guard<std::mutex> lock(shards_[book->shard].mutex);
+            if (ownedLocked(*book)) {
+                return rejectOwned(*book, "remove");
+            }
+            if (!book->live.load(std::memory_order_relaxed)) {
+                return Status::NotFound;
+            }
+            lsn = journal(*book, LogAction::Remove, kNoOrderId, 0, V(), Side::Buy);
+            forgetOrders(*book);
+            book->clearLevels();
+            book->publishSummary(false, V());
+            emitClear(*book);
+        }
+        return awaitDurable(lsn);
+    }
+
+    // Test case for inserting orders
+    bool testInsert() {
+        insert("TEST", Order<K, V>(10, 2));
+        {
+            const auto& ladder = books_[lookup("TEST")].bids;
+            assert(ladder.depth() == 1);
+            assert(ladder.find(2)->lotSize.load() == 10);
+        }
+        insert("TEST", Order<K, V>(20, 2));
+        {
+            const auto& ladder = books_[lookup("TEST")].bids;
+            assert(ladder.depth() == 1);
+            assert(ladder.find(2)->lotSize.load() == 30);
+        }
+        insert("TEST", 5, 2);
+        {
+            const auto& ladder = books_[lookup("TEST")].bids;
+            assert(ladder.depth() == 1);
+            assert(ladder.find(2)->lotSize.load() == 35);
+        }
+        return true;
+    }
+
+    // Test case for removing orders
+    bool testRemove() {
+        insert("TEST", Order<K, V>(10, 2));
+        remove("TEST");
+        assert(!books_[lookup("TEST")].live.load());
+        return true;
+    }
+
+    // Test case for displaying orders
+    bool testDisplay() {
+        insert("TEST", Order<K, V>(10, 2));
+        display();  // This should not assert but display output
+        return true;
+    }
+
+    // Test case for price range
+    bool testPriceRange() {
+        insert("TEST", Order<K, V>(10, 2));
+        insert("TEST", Order<K, V>(20, 5));
+        insert("TEST", Order<K, V>(30, 1));
+        auto range = getPriceRange("TEST");
+        assert(range->first == 1);
+        assert(range->second == 5);
+        insert("TEST", Order<K, V>(5, -3));
+        range = getPriceRange("TEST");
+        assert(range->first == -3);
+        assert(range->second == 5);
+        return true;
+    }
+
+    // Test case for levels staying sorted regardless of arrival order
+    bool testLadderOrder() {
+        insert("LADDER", 1, 7);
+        insert("LADDER", 1, 3);
+        insert("LADDER", 1, 9);
+        insert("LADDER", 1, 3);
+        const auto& ladder = books_[lookup("LADDER")].bids;
+        std::vector<int> prices;
+        ladder.forEach([&prices](const PriceLevel<V>& level) {
+            prices.push_back(level.price);
+        });
+        assert((prices == std::vector<int>{3, 7, 9}));
+        assert(ladder.find(3)->lotSize.load() == 2);
+        assert(ladder.lowest().price == 3);
+        assert(ladder.highest().price == 9);
+        remove("LADDER");
+        return true;
+    }
+
+    // Test case for dense symbol ids and the id-based overloads
+    bool testInterning() {
+        const SymbolId first = intern("INTERN_A");
+        const SymbolId second = intern("INTERN_B");
+        assert(first != kInvalidSymbol);
+        assert(second == first + 1);
+        assert(intern("INTERN_A") == first);
+        assert(lookup("INTERN_B") == second);
+        assert(lookup("INTERN_MISSING") == kInvalidSymbol);
+
+        insert(first, 4, 11);
+        insert("INTERN_A", 6, 13);
+        auto range = getPriceRange(first);
+        assert(range->first == 11);
+        assert(range->second == 13);
+        remove(first);
+        assert(!books_[first].live.load());
+        return true;
+    }
+
+    // Test case for batched inserts matching the per-call path
+    bool testInsertBatch() {
+        const SymbolId a = intern("BATCH_A");
+        const SymbolId b = intern("BATCH_B");
+        std::vector<OrderUpdate<V>> updates = {
+            {a, 1, 10}, {b, 2, 20}, {a, 3, 10}, {b, 4, 15}, {a, 5, 12}, {kInvalidSymbol - 2, 1, 1}
+        };
+        insertBatch(updates);
+        assert(books_[a].bids.find(10)->lotSize.load() == 4);
+        assert(books_[a].bids.find(12)->lotSize.load() == 5);
+        assert(books_[b].bids.depth() == 2);
+        auto range = getPriceRange(b);
+        assert(range->first == 15);
+        assert(range->second == 20);
+        remove(a);
+        remove(b);
+        return true;
+    }
+
+    // Test case for the lock-free per-symbol summary
+    bool testSummary() {
+        insert("SUMMARY", 5, 100);
+        insert("SUMMARY", 7, 98);
+        insert("SUMMARY", 3, 100);
+        BookSummary<V> summary = getSummary("SUMMARY");
+        assert(summary.live);
+        assert(summary.lowPrice == 98);
+        assert(summary.highPrice == 100);
+        assert(summary.depth == 2);
+        assert(summary.totalLot == 15);
+        remove("SUMMARY");
+        summary = getSummary("SUMMARY");
+        assert(!summary.live);
+        assert(summary.depth == 0);
+        assert(!getSummary("SUMMARY_MISSING").live);
+        return true;
+    }
+
+    // Test case for readers seeing consistent summaries while a writer races them
+    bool testConcurrentSummary() {
+        const SymbolId id = intern("SEQLOCK");
+        const int levels = 20000;
+        std::atomic<bool> done{false};
+        std::thread writer([this, id, levels, &done]() {
+            // Each insert opens a new level with lot 1 at the next price up
+            for (int price = 0; price < levels; ++price) {
+                insert(id, 1, price);
+            }
+            done.store(true);
+        });
+        while (!done.load()) {
+            const BookSummary<V> summary = getSummary(id);
+            if (summary.live) {
+                assert(static_cast<std::size_t>(summary.totalLot) == summary.depth);
+                assert(summary.highPrice - summary.lowPrice + 1 == static_cast<int>(summary.depth));
+            }
+        }
+        writer.join();
+        assert(getSummary(id).depth == static_cast<std::size_t>(levels));
+        remove(id);
+        return true;
+    }
+
+    // Test case for snapshot iteration and epoch reclamation
+    bool testSnapshots() {
+        const SymbolId id = intern("SNAPSHOT");
+        insert(id, 2, 50);
+        insert(id, 3, 40);
+
+        EpochDomain::Guard guard(epochs_);
+        const BookSnapshot<V>* first = snapshotOf(books_[id]);
+        assert(first->bids.size() == 2);
+        assert(first->bids[0].price == 40);
+        assert(first->bids[1].lotSize == 2);
+        assert(snapshotOf(books_[id]) == first);  // Unchanged book reuses its snapshot
+
+        // A writer replaces the snapshot, but the pinned copy stays readable
+        insert(id, 5, 50);
+        const BookSnapshot<V>* second = snapshotOf(books_[id]);
+        assert(second != first);
+        assert(second->bids[1].lotSize == 7);
+        assert(first->bids[1].lotSize == 2);
+        epochs_.reclaim();
+        assert(epochs_.pendingCount() >= 1);
+
+        remove(id);
+        return true;
+    }
+
+    // Test case for the pool-backed asynchronous operations
+    bool testAsync() {
+        WorkStealingPool pool(4);
+        std::vector<std::future<void>> futures;
+        for (int i = 0; i < 100; ++i) {
+            futures.push_back(insertAsync(pool, "ASYNC", 1, i % 10));
+        }
+        for (auto& future : futures) {
+            future.get();
+        }
+        assert(getSummary("ASYNC").totalLot == 100);
+        auto range = getPriceRangeAsync(pool, "ASYNC").get();
+        assert(range->first == 0);
+        assert(range->second == 9);
+        removeAsync(pool, "ASYNC").get();
+        assert(!getSummary("ASYNC").live);
+
+        // Work submitted from inside the pool runs on the same pool
+        auto nested = pool.submit([&pool]() {
+            return pool.submit([]() {
+                return 42;
+            });
+        });
+        assert(nested.get().get() == 42);
+        return true;
+    }
+
+    // Test case for the shard-per-core single-writer mode
+    bool testShardActors() {
+        const SymbolId a = intern("ACTOR_A");
+        const SymbolId b = intern("ACTOR_B");
+        {
+            ShardActors<K, V, Alloc> actors(*this, 2, 2, 16);
+            std::vector<std::thread> producers;
+            for (std::size_t p = 0; p < 2; ++p) {
+                producers.emplace_back([&actors, p, a, b]() {
+                    for (int i = 0; i < 1000; ++i) {
+                        actors.insert(p, i % 2 == 0 ? a : b, 1, i % 5);
+                    }
+                });
+            }
+            for (auto& producer : producers) {
+                producer.join();
+            }
+            assert(!actors.insert(0, a, 0, 50) && !actors.insert(0, a, -1, 51));
+            actors.flush();
+            assert(getSummary(a).totalLot == 1000);
+            assert(getSummary(b).depth == 5);
+
+            // Owned books are visible through their owners' snapshots
+            std::size_t seen = 0;
+            forEachBook([&seen](const K& symbol, const BookSnapshot<V>& snapshot) {
+                if (symbol == K("ACTOR_A") || symbol == K("ACTOR_B")) {
+                    assert(snapshot.bids.size() == 5);
+                    ++seen;
+                }
+            });
+            assert(seen == 2);
+
+            // The locked entry points refuse owned books rather than race the owner
+            const std::string path = "/tmp/chm_test_owned_" + std::to_string(getpid());
+            assert(insert(b, 1, 100) == Status::Rejected);
+            assert(addOrder(b, 4001, 1, 100) == Status::Rejected);
+            assert(!hasOrder(4001));
+            assert(useTickLadder(b, 100, 1) == Status::Rejected);
+            assert(remove(b) == Status::Rejected);
+            assert(releaseBooks() == Status::Rejected);
+            const std::uint64_t refusals = DiagnosticLog::global().reported(DiagnosticKind::ShardOwned);
+            assert(!snapshot(path));  // Reported through the log, not under the shard lock on stderr
+            assert(DiagnosticLog::global().reported(DiagnosticKind::ShardOwned) == refusals + 1);
+            actors.flush();
+            assert(getSummary(b).depth == 5);
+
+            actors.remove(0, a);
+            actors.flush();
+            assert(!getSummary(a).live);
+        }
+        // Ownership is handed back, so the locked path works again
+        insert(b, 1, 100);
+        assert(getPriceRange(b)->second == 100);
+        remove(b);
+
+        // Owners journal what they apply, so a restart recovers it
+        const std::string path = "/tmp/chm_test_actor_journal_" + std::to_string(getpid());
+        std::remove(path.c_str());
+        {
+            std::unique_ptr<Journal> journal = Journal::open(path);
+            assert(journal != nullptr);
+            journalTo(journal.get());
+            {
+                ShardActors<K, V, Alloc> actors(*this, 2, 1, 16);
+                for (int i = 0; i < 100; ++i) {
+                    actors.insert(0, i % 2 == 0 ? a : b, 1, i % 5);
+                }
+                actors.remove(0, b);
+                actors.insert(0, b, 3, 7);
+                actors.flush();
+            }
+            journalTo(nullptr);
+        }
+        ConcurrentHashMap<K, V> recovered(2);
+        const ReplayStats stats = recoverJournal(recovered, path);
+        std::remove(path.c_str());
+        assert(stats.rejected == 0);
+        assert(recovered.getSummary("ACTOR_A").totalLot == 50 && recovered.getSummary("ACTOR_A").depth == 5);
+        assert(recovered.getSummary("ACTOR_B").totalLot == 3 && recovered.getPriceRange("ACTOR_B")->first == 7);
+        remove(a);
+        remove(b);
+        return true;
+    }
+
+    // Test case for the MPSC ingress front end and its accounting
+    bool testIngress() {
+        const SymbolId id = intern("INGRESS");
+        {
+            IngressQueue<K, V, Alloc> ingress(*this, 64, BackpressurePolicy::Yield, 16);
+            std::vector<std::thread> producers;
+            for (int p = 0; p < 3; ++p) {
+                producers.emplace_back([&ingress, id]() {
+                    for (int i = 0; i < 500; ++i) {
+                        ingress.insert(id, 1, i % 7);
+                    }
+                });
+            }
+            for (auto& producer : producers) {
+                producer.join();
+            }
+            ingress.insert(K("INGRESS"), 1, 3);
+            assert(!ingress.insert(id, 0, 8) && !ingress.insert(id, -2, 9));
+            ingress.flush();
+            const IngressMetrics metrics = ingress.metrics();
+            assert(metrics.enqueued == 1501);
+            assert(metrics.applied == 1501);
+            assert(metrics.rejected == 0 && metrics.dropped == 0 && metrics.failedBatches == 0);
+            assert(metrics.highWaterMark <= 64);
+
+            // A refused update is counted once its batch has been applied,
+            // including by an applier that has parked in the meantime
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            ingress.insert(static_cast<SymbolId>(symbolCapacity() - 1), 1, 3);
+            ingress.flush();
+            assert(ingress.metrics().failedBatches == 1);
+            assert(ingress.metrics().rejected == 1 && ingress.metrics().applied == 1501);
+            assert(getSummary(id).totalLot == 1501);
+        }
+        remove(id);
+
+        // Under Drop every insert is either applied or counted as dropped
+        {
+            IngressQueue<K, V, Alloc> ingress(*this, 2, BackpressurePolicy::Drop, 1);
+            for (int i = 0; i < 1000; ++i) {
+                ingress.insert(id, 1, 0);
+            }
+            ingress.flush();
+            const IngressMetrics metrics = ingress.metrics();
+            assert(metrics.enqueued + metrics.dropped == 1000);
+            assert(getSummary(id).totalLot == static_cast<V>(metrics.applied));
+        }
+        remove(id);
+        return true;
+    }
+
+    // Test case for arena-backed books and the end-of-day release
+    bool testArena() {
+        SlabArena arena(4096);
+        {
+            ConcurrentHashMap<K, V, ArenaAllocator<char>> arenaMap(4, 64, ArenaAllocator<char>(arena));
+            for (int i = 0; i < 500; ++i) {
+                arenaMap.insert(K("ARENA_A"), 1, i);
+                arenaMap.insert(K("ARENA_B"), 2, i % 10);
+            }
+            assert(arenaMap.getSummary(K("ARENA_A")).depth == 500);
+            assert(arenaMap.getSummary(K("ARENA_B")).totalLot == 1000);
+            assert(arena.slabCount() > 0);
+
+            // Freed levels are reused before the arena grows
+            arenaMap.remove(K("ARENA_A"));
+            const std::size_t slabs = arena.slabCount();
+            for (int i = 0; i < 500; ++i) {
+                arenaMap.insert(K("ARENA_A"), 1, i);
+            }
+            assert(arena.slabCount() == slabs);
+
+            assert(arenaMap.releaseBooks() == Status::Ok);
+            arena.releaseAll();
+            assert(arena.slabCount() == 0);
+            assert(!arenaMap.getSummary(K("ARENA_A")).live);
+
+            // The map keeps working on fresh slabs after the release
+            arenaMap.insert(K("ARENA_A"), 3, 7);
+            assert(arenaMap.getPriceRange(K("ARENA_A"))->first == 7);
+        }
+
+        // Without an arena levels come from the heap and are freed one by one
+        {
+            ConcurrentHashMap<K, V, ArenaAllocator<char>> heapMap(1, 16);
+            for (int i = 0; i < 1000; ++i) {
+                heapMap.insert(K("ARENA_HEAP"), 1, i);
+            }
+            assert(!ArenaAllocator<char>().releasesWholesale());
+            assert(heapMap.releaseBooks() == Status::Ok);
+            assert(!heapMap.getSummary(K("ARENA_HEAP")).live);
+        }
+
+        // A short-lived arena's slot is reused without its stale free lists
+        for (int round = 0; round < 100; ++round) {
+            SlabArena scratch(4096);
+            void* block = scratch.allocate(32);
+            assert(scratch.slabCount() == 1);
+            if (round % 2 == 0) {
+                scratch.deallocate(block, 32);
+            }
+        }
+        return true;
+    }
+
+    // Test case for tick-indexed books, their tree fallback and recentring
+    bool testTickLadder() {
+        const SymbolId id = intern("TICK");
+        insert(id, 4, 1000);  // Existing levels move into the window
+        useTickLadder(id, 1000, 5, 64);
+        const auto& ladder = books_[id].bids;
+        assert(ladder.tickIndexed());
+        assert(ladder.windowDepth() == 1);
+
+        insert(id, 1, 1005);
+        insert(id, 2, 1005);
+        insert(id, 1, 990);
+        insert(id, 1, 1002);  // Off the tick grid
+        insert(id, 1, 9000);  // Outside the window
+        assert(ladder.windowDepth() == 3);
+        assert(ladder.depth() == 5);
+        assert(ladder.find(1005)->lotSize.load() == 3);
+        assert(ladder.find(1002)->lotSize.load() == 1);
+        assert(ladder.find(995) == nullptr);
+
+        std::vector<int> prices;
+        ladder.forEach([&prices](const PriceLevel<V>& level) {
+            prices.push_back(level.price);
+        });
+        assert((prices == std::vector<int>{990, 1000, 1002, 1005, 9000}));
+        auto range = getPriceRange(id);
+        assert(range->first == 990);
+        assert(range->second == 9000);
+
+        // Prices drift far away; once outliers outnumber the window it moves
+        for (int price = 5000; price < 5100; price += 5) {
+            insert(id, 1, price);
+        }
+        assert(ladder.depth() == 25);
+        assert(ladder.windowDepth() > ladder.depth() - ladder.windowDepth());
+        assert(getSummary(id).totalLot == 30);
+        assert(ladder.find(5050)->lotSize.load() == 1);
+        assert(ladder.lowest().price == 990);
+        assert(ladder.highest().price == 9000);
+
+        // Off-grid levels never count towards moving the window
+        const std::size_t windowed = ladder.windowDepth();
+        for (int round = 0; round < 3; ++round) {
+            for (int price = 5001; price < 5100; price += 5) {
+                insert(id, 1, price);
+            }
+        }
+        assert(ladder.windowDepth() == windowed);
+        assert(ladder.depth() == 45);
+        assert(ladder.find(5001)->lotSize.load() == 3);
+
+        remove(id);
+        assert(ladder.depth() == 0);
+        return true;
+    }
+
+    // Test case for two-sided books and the best bid / offer
+    bool testTopOfBook() {
+        const SymbolId id = intern("TOP");
+        insert(id, 5, 99);
+        insert("TOP", Order<K, V>(3, 101, Side::Sell));
+        TopOfBook<V> top = getTopOfBook("TOP");
+        assert(top.live && top.hasBid && top.hasAsk);
+        assert(top.bidPrice == 99 && top.bidLot == 5);
+        assert(top.askPrice == 101 && top.askLot == 3);
+        assert(top.spread() == 2);
+
+        // Better prices move the top; worse ones and lot on the top update it
+        insert(id, 2, 100, Side::Buy);
+        insert(id, 4, 104, Side::Sell);
+        insert(id, 6, 101, Side::Sell);
+        top = getTopOfBook(id);
+        assert(top.bidPrice == 100 && top.bidLot == 2);
+        assert(top.askPrice == 101 && top.askLot == 9);
+
+        // Range, depth and total lot cover both sides
+        const BookSummary<V> summary = getSummary(id);
+        assert(summary.lowPrice == 99 && summary.highPrice == 104);
+        assert(summary.depth == 4);
+        assert(summary.totalLot == 20);
+
+        remove(id);
+        top = getTopOfBook(id);
+        assert(!top.live && !top.hasBid && !top.hasAsk);
+
+        // One-sided books report only the side they have
+        insert(id, 1, 50, Side::Sell);
+        top = getTopOfBook(id);
+        assert(!top.hasBid && top.hasAsk && top.askPrice == 50);
+        remove(id);
+        return true;
+    }
+
+    // Test case for cancelling and modifying individual orders by id
+    bool testOrderIds() {
+        const SymbolId id = intern("ORDERS");
+        insert("ORDERS", Order<K, V>(1001, 10, 50, Side::Buy));
+        assert(addOrder(id, 1002, 5, 50, Side::Buy) == Status::Ok);
+        assert(addOrder(id, 1003, 7, 52, Side::Sell) == Status::Ok);
+        assert(addOrder(id, 1002, 1, 49) == Status::Duplicate);
+        insert(id, 3, 50);                   // Anonymous lot shares the level
+
+        assert(cancel(1001) == Status::Ok);
+        assert(books_[id].bids.find(50)->lotSize.load() == 8);
+        assert(cancel(1001) == Status::NotFound);
+
+        assert(modify(1002, 2) == Status::Ok);
+        assert(books_[id].bids.find(50)->lotSize.load() == 5);
+        assert(modify(1003, 9) == Status::Ok);
+        TopOfBook<V> top = getTopOfBook(id);
+        assert(top.bidLot == 5 && top.askLot == 9);
+        assert(getSummary(id).totalLot == 14);
+
+        assert(modify(1003, 0) == Status::Ok);  // Modifying to nothing cancels
+        assert(cancel(1003) == Status::NotFound);
+
+        // Removing the book drops the orders that were resting in it, and
+        // their ids can be used again
+        const std::size_t indexed = orders_.size();
+        remove(id);
+        assert(orders_.size() == indexed - 1);
+        insert(id, 4, 50);
+        assert(cancel(1002) == Status::NotFound);
+        assert(books_[id].bids.find(50)->lotSize.load() == 4);
+        assert(modify(99999, 1) == Status::NotFound);
+        assert(addOrder(id, 1002, 1, 51) == Status::Ok);
+        remove(id);
+        assert(orders_.size() == indexed - 1);
+        return true;
+    }
+
+    // Test case for reducing levels, unlinking empty ones and reusing them
+    bool testReduce() {
+        const SymbolId id = intern("REDUCE");
+        insert(id, 5, 10);
+        insert(id, 5, 20);
+        insert(id, 5, 30);
+        insert(id, 2, 31, Side::Sell);
+
+        assert(reduce("REDUCE", 20, 3) == Status::Ok);
+        assert(books_[id].bids.find(20)->lotSize.load() == 2);
+        assert(reduce(id, 30, 5) == Status::Ok);  // Emptying the top level unlinks it
+        assert(books_[id].bids.find(30) == nullptr);
+        assert(getTopOfBook(id).bidPrice == 20);
+        assert(reduce(id, 31, 10, Side::Sell) == Status::Ok);  // Over-reduce takes what is left
+        assert(!getTopOfBook(id).hasAsk);
+        auto range = getPriceRange(id);
+        assert(range->first == 10 && range->second == 20);
+        assert(getSummary(id).totalLot == 7);
+        assert(reduce(id, 30, 1) == Status::NotFound);
+
+        // Lots that would grow a level or an order are rejected
+        assert(reduce(id, 20, -50) == Status::Rejected);
+        assert(reduce("REDUCE", 20, 0) == Status::Rejected);
+        assert(books_[id].bids.find(20)->lotSize.load() == 2);
+        assert(addOrder(id, 2002, 0, 20) == Status::Rejected);
+        assert(addOrder(id, 2002, 1, 20) == Status::Ok);
+        assert(modify(2002, -3) == Status::Rejected);
+        assert(books_[id].bids.find(20)->lotSize.load() == 3);
+        assert(cancel(2002) == Status::Ok);
+
+        // Modifying to the same lot leaves a level emptied by reduces unlinked
+        assert(addOrder(id, 2003, 2, 60) == Status::Ok);
+        assert(reduce(id, 60, 2) == Status::Ok);
+        assert(modify(2003, 2) == Status::Ok);
+        assert(books_[id].bids.find(60) == nullptr && books_[id].bids.depth() == 2);
+        assert(cancel(2003) == Status::Ok);
 
-    // Default constructor
-    Order() : lotSize(new std::atomic<V>(0)), price(0) {}
+        // Lots that are not positive never reach the ladder
+        assert(insert(id, 0, 5) == Status::Rejected);
+        assert(insert("REDUCE", -5, 20) == Status::Rejected);
+        assert(insertBatch({{id, 1, 21, Side::Buy}, {id, 0, 7, Side::Buy}, {id, -3, 99, Side::Sell}}) ==
+               Status::Rejected);
+        assert(books_[id].bids.find(20)->lotSize.load() == 2);
+        assert(books_[id].bids.find(5) == nullptr && books_[id].bids.find(7) == nullptr);
+        assert(!getTopOfBook(id).hasAsk && getPriceRange(id)->second == 21);
+        assert(reduce(id, 21, 1) == Status::Ok);
+
+        // Unlinked nodes are recycled for new levels
+        insert(id, 4, 40);
+        assert(books_[id].bids.find(40)->lotSize.load() == 4);
+        assert(books_[id].bids.depth() == 3);
+
+        // A cancel that empties a level removes it too
+        assert(addOrder(id, 2001, 6, 50) == Status::Ok);
+        assert(cancel(2001) == Status::Ok);
+        assert(books_[id].bids.find(50) == nullptr);
+        assert(getPriceRange(id)->second == 40);
+
+        // Tick-indexed levels clear their occupancy bit
+        useTickLadder(id, 0, 1, 64);
+        assert(reduce(id, 40, 4) == Status::Ok);
+        assert(books_[id].bids.windowDepth() == 2);
+        assert(getTopOfBook(id).bidPrice == 20);
+        remove(id);
+        return true;
+    }
+
+    // Test case for price-time matching against the opposite side
+    bool testMatching() {
+        MatchingEngine<K, V, Alloc> engine(*this);
+        const SymbolId id = intern("MATCH");
+        std::vector<Trade<V>> trades;
+        assert(engine.submit(id, 1, Side::Sell, 5, 101, trades).resting == 5);
+        assert(engine.submit(id, 2, Side::Sell, 5, 100, trades).resting == 5);
+        assert(engine.submit("MATCH", 3, Side::Sell, 4, 100, trades).resting == 4);
+        assert(engine.submit(id, 4, Side::Buy, 2, 99, trades).resting == 2);
+        assert(trades.empty());
+
+        // Best price first, then arrival order within the price
+        assert(engine.submit(id, 5, Side::Buy, 12, 101, trades).resting == 0);
+        assert(trades.size() == 3);
+        assert(trades[0].resting == 2 && trades[0].price == 100 && trades[0].lot == 5);
+        assert(trades[1].resting == 3 && trades[1].lot == 4);
+        assert(trades[2].resting == 1 && trades[2].price == 101 && trades[2].lot == 3);
+        TopOfBook<V> top = getTopOfBook(id);
+        assert(top.askPrice == 101 && top.askLot == 2);
+        assert(top.bidPrice == 99 && top.bidLot == 2);
+
+        // A sell that crosses only part of the book rests its remainder
+        trades.clear();
+        assert(engine.submit(id, 6, Side::Sell, 5, 99, trades).resting == 3);
+        assert(trades.size() == 1 && trades[0].resting == 4);
+        top = getTopOfBook(id);
+        assert(!top.hasBid && top.askPrice == 99 && top.askLot == 3);
+
+        assert(engine.cancel(id, 6, Side::Sell, 99));
+        assert(!engine.cancel(id, 6, Side::Sell, 99));
+        assert(getTopOfBook(id).askPrice == 101);
+        assert(engine.cancel(id, 1, Side::Sell, 101));
+        assert(getSummary(id).depth == 0);
+
+        // Bad lots and ids already resting are refused before any trade
+        assert(engine.submit(id, 7, Side::Sell, 4, 100, trades).status == Status::Ok);
+        trades.clear();
+        assert(engine.submit(id, 8, Side::Buy, -3, 100, trades).status == Status::Rejected);
+        const SymbolId neverInterned = static_cast<SymbolId>(symbolCapacity() - 1);
+        assert(engine.submit(neverInterned, 8, Side::Buy, 1, 100, trades).status == Status::Rejected);
+        assert(engine.submit(id, 7, Side::Buy, 1, 100, trades).status == Status::Duplicate);
+        assert(trades.empty() && getTopOfBook(id).askLot == 4);
+
+        // An engine order cancelled through the map no longer trades
+        assert(cancel(7) == Status::Ok);
+        const SubmitResult<V> result = engine.submit(id, 9, Side::Buy, 2, 100, trades);
+        assert(trades.empty() && result.status == Status::Ok && result.resting == 2);
+        assert(engine.cancel(id, 9, Side::Buy, 100));
+        remove(id);
+        return true;
+    }
+
+    // Test case for rebuilding books from the shared-memory delta ring
+    bool testDeltaRing() {
+        const std::string name = "/chm_test_deltas_" + std::to_string(getpid());
+        std::unique_ptr<L2DeltaRing> ring = L2DeltaRing::create(name, 8);
+        assert(ring != nullptr);
+        std::unique_ptr<L2DeltaRing> reader = L2DeltaRing::open(name);
+        L2DeltaRing::remove(name);
+        assert(reader != nullptr && reader->capacity() == 8);
+
+        const SymbolId id = intern("DELTAS");
+        insert(id, 4, 10);  // Before publishing starts; not streamed
+        publishDeltas(ring.get());
+        insert(id, 3, 10);
+        insert(id, 2, 12, Side::Sell);
+        reduce(id, 10, 7);
+        insert(id, 5, 11);
+        publishDeltas(nullptr);
+        insert(id, 1, 11);
+
+        L2Replica replica;
+        L2Delta delta;
+        std::uint64_t position = 0;
+        while (reader->read(position, delta) == L2DeltaRing::ReadStatus::Ok) {
+            assert(delta.sequence == position + 1);
+            replica.apply(delta);
+            ++position;
+        }
+        assert(position == 4);
+        assert(replica.lot(id, Side::Buy, 10) == 0);  // Reduced away
+        assert(replica.lot(id, Side::Sell, 12) == 2);
+        assert(replica.lot(id, Side::Buy, 11) == 5);
+        assert(replica.depth(id) == 2);
+
+        // Clearing a book streams a single record; lapped readers see overruns
+        publishDeltas(ring.get());
+        remove(id);
+        assert(reader->read(position, delta) == L2DeltaRing::ReadStatus::Ok);
+        replica.apply(delta);
+        assert(replica.depth(id) == 0);
+        for (int price = 0; price < 10; ++price) {
+            insert(id, 1, price);
+        }
+        publishDeltas(nullptr);
+        assert(reader->read(position, delta) == L2DeltaRing::ReadStatus::Overrun);
+        assert(reader->read(reader->published(), delta) == L2DeltaRing::ReadStatus::Empty);
+        remove(id);
+
+        // A capacity that is not a power of two or overruns the segment is refused
+        std::unique_ptr<L2DeltaRing> foreign = L2DeltaRing::create(name, 8);
+        assert(foreign != nullptr);
+        for (std::uint64_t capacity : {std::uint64_t(6), std::uint64_t(16), std::uint64_t(0)}) {
+            const int fd = shm_open(name.c_str(), O_RDWR, 0);
+            assert(fd >= 0 && ::pwrite(fd, &capacity, sizeof(capacity), sizeof(std::uint64_t)) ==
+                                  static_cast<ssize_t>(sizeof(capacity)));
+            ::close(fd);
+            assert(L2DeltaRing::open(name) == nullptr);
+        }
+        L2DeltaRing::remove(name);
+        return true;
+    }
+
+    // Test case for writing, mapping and replaying a binary order log
+    bool testOrderLog() {
+        const std::string path = "/tmp/chm_test_log_" + std::to_string(getpid());
+        auto record = [](OrderId orderId, std::uint32_t symbol, int price, int lot, LogAction action, Side side) {
+            OrderLogRecord r{};
+            r.orderId = orderId;
+            r.symbol = symbol;
+            r.price = price;
+            r.lot = lot;
+            r.action = action;
+            r.side = side;
+            return r;
+        };
+        const std::vector<OrderLogRecord> records = {
+            record(1, 0, 100, 5, LogAction::Add, Side::Buy),
+            record(2, 1, 200, 7, LogAction::Add, Side::Sell),
+            record(3, 0, 101, 4, LogAction::Add, Side::Sell),
+            record(kNoOrderId, 1, 199, 3, LogAction::Add, Side::Buy),
+            record(1, 0, 0, 2, LogAction::Modify, Side::Buy),
+            record(3, 0, 0, 0, LogAction::Cancel, Side::Sell),
+            record(0, 1, 199, 1, LogAction::Reduce, Side::Buy),
+            record(99, 1, 0, 0, LogAction::Cancel, Side::Buy),  // Unknown order
+            record(4, 0, 102, 1, LogAction::Add, static_cast<Side>(7)),  // Corrupt side
+            record(5, 0, 102, 1, static_cast<LogAction>(9), Side::Buy),  // Corrupt action
+            record(kNoOrderId, 2, 0, 0, LogAction::Remove, Side::Buy),  // Book never added
+        };
+        assert(writeOrderLog(path, {"LOGA", "LOGB", "LOGC"}, records));
+        std::unique_ptr<MappedOrderLog> log = MappedOrderLog::open(path);
+        std::remove(path.c_str());
+        assert(log != nullptr);
+        assert(log->symbolCount() == 3 && log->symbol(1) == "LOGB");
+        assert(log->recordCount() == records.size());
+
+        const ReplayStats stats = replayOrderLog(*this, *log, 2);
+        assert(stats.records == records.size());
+        assert(stats.rejected == 4);
+        TopOfBook<V> a = getTopOfBook("LOGA");
+        assert(a.bidPrice == 100 && a.bidLot == 2 && !a.hasAsk);
+        TopOfBook<V> b = getTopOfBook("LOGB");
+        assert(b.bidPrice == 199 && b.bidLot == 2 && b.askPrice == 200 && b.askLot == 7);
+        cancel(1);
+        cancel(2);
+        remove("LOGA");
+        remove("LOGB");
+
+        // A record count whose byte size wraps around is refused
+        assert(writeOrderLog(path, {"LOGA"}, records));
+        OrderLogHeader header{kOrderLogMagic, 1, 1, 0x0AAAAAAAAAAAAAABull};  // 24 * count wraps to 8
+        const int fd = ::open(path.c_str(), O_WRONLY);
+        assert(fd >= 0 && ::pwrite(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)));
+        ::close(fd);
+        assert(MappedOrderLog::open(path) == nullptr);
+        std::remove(path.c_str());
+        return true;
+    }
+
+    // Test case for journaling from several threads and recovering from it
+    bool testJournal() {
+        const std::string path = "/tmp/chm_test_journal_" + std::to_string(getpid());
+        std::remove(path.c_str());
+        {
+            std::unique_ptr<Journal> journal = Journal::open(path);
+            assert(journal != nullptr);
+            journalTo(journal.get());
+            const SymbolId id = intern("JOURNAL_A");
+            std::vector<std::thread> writers;
+            for (int t = 0; t < 4; ++t) {
+                writers.emplace_back([this, t]() {
+                    const std::string symbol = t % 2 == 0 ? "JOURNAL_A" : "JOURNAL_B";
+                    for (int n = 0; n < 50; ++n) {
+                        insert(symbol, 1, 100 + n % 5, t < 2 ? Side::Buy : Side::Sell);
+                    }
+                });
+            }
+            for (auto& writer : writers) {
+                writer.join();
+            }
+            assert(addOrder(id, 3001, 9, 90) == Status::Ok);
+            assert(addOrder(id, 3002, 4, 91) == Status::Ok);
+            assert(modify(3001, 6) == Status::Ok);
+            assert(cancel(3002) == Status::Ok);
+            assert(reduce(id, 104, 3, Side::Buy) == Status::Ok);
+            insertBatch({{id, 2, 95, Side::Sell}, {id, 3, 96, Side::Sell}});
+            insert("JOURNAL_C", 7, 1);
+            remove("JOURNAL_C");
+            insert("JOURNAL_LONG_NAME_ONE", 1, 5);  // Names span several records
+            insert("JOURNAL_LONG_NAME_TWO", 2, 6);
+            journalTo(nullptr);
+            assert(journal->syncs() <= journal->appended());
+        }
+
+        ConcurrentHashMap<K, V> recovered(4);
+        const ReplayStats stats = recoverJournal(recovered, path);
+        std::remove(path.c_str());
+        assert(stats.rejected == 0);
+        for (const char* symbol : {"JOURNAL_A", "JOURNAL_B", "JOURNAL_C", "JOURNAL_LONG_NAME_ONE",
+                                   "JOURNAL_LONG_NAME_TWO"}) {
+            const BookSummary<V> before = getSummary(symbol);
+            const BookSummary<V> after = recovered.getSummary(symbol);
+            assert(before.live == after.live && before.depth == after.depth);
+            assert(before.totalLot == after.totalLot);
+            assert(before.lowPrice == after.lowPrice && before.highPrice == after.highPrice);
+        }
+        assert(recovered.getTopOfBook("JOURNAL_A").bidLot == getTopOfBook("JOURNAL_A").bidLot);
+        assert(recovered.modify(3001, 1) == Status::Ok);  // Indexed orders survive recovery
+
+        // Files that are not journals are refused and left as they were
+        assert(writeOrderLog(path, {"JOURNAL_A"}, {}));
+        assert(Journal::open(path) == nullptr);
+        std::unique_ptr<FILE, int (*)(FILE*)> shortFile(std::fopen(path.c_str(), "wb"), &std::fclose);
+        assert(shortFile != nullptr && std::fputs("BOOK", shortFile.get()) >= 0);
+        shortFile.reset();
+        assert(Journal::open(path) == nullptr);
+        struct stat info;
+        assert(::stat(path.c_str(), &info) == 0 && info.st_size == 4);
+        std::remove(path.c_str());
+
+        // Checkpoints keep names at full length
+        assert(snapshot(path));
+        ConcurrentHashMap<K, V> restored(2);
+        assert(restored.load(path));
+        std::remove(path.c_str());
+        assert(restored.getSummary("JOURNAL_LONG_NAME_ONE").totalLot == 1);
+        assert(restored.getSummary("JOURNAL_LONG_NAME_TWO").lowPrice == 6);
+        assert(!restored.getSummary("JOURNAL_LONG_NAME").live);
+
+        // Lots wider than a record's lot field are refused on every path
+        {
+            std::unique_ptr<Journal> wideJournal = Journal::open(path);
+            assert(wideJournal != nullptr);
+            ConcurrentHashMap<K, long long> wide(2);
+            wide.journalTo(wideJournal.get());
+            const SymbolId id = wide.intern("JOURNAL_WIDE");
+            const long long lot = 1LL << 40;
+            assert(wide.insert(id, lot, 10) == Status::Rejected);
+            assert(wide.insertBatch({{id, lot, 10, Side::Buy}}) == Status::Rejected);
+            assert(wide.insertBatch({{id, 1, 10, Side::Buy}, {id + 1, 1, 10, Side::Buy}}) == Status::NotFound);
+            assert(wide.getSummary("JOURNAL_WIDE").totalLot == 1);
+            wide.journalTo(nullptr);
+        }
+        std::remove(path.c_str());
+
+        cancel(3001);
+        remove("JOURNAL_A");
+        remove("JOURNAL_B");
+        remove("JOURNAL_LONG_NAME_ONE");
+        remove("JOURNAL_LONG_NAME_TWO");
+        return true;
+    }
 
-    // Constructor with parameters
-    Order(V lotSize, int price) : lotSize(new std::atomic<V>(lotSize)), price(price) {}
+    // Test case for a journal whose writes fail: changes still apply in
+    // memory but report WriteFailed, and the dead journal takes no records
+    bool testJournalFailure() {
+        const std::string path = "/tmp/chm_test_journal_failure_" + std::to_string(getpid());
+        std::remove(path.c_str());
+        std::unique_ptr<Journal> journal = Journal::open(path);
+        assert(journal != nullptr);
+        int pipeFds[2];
+        assert(pipe(pipeFds) == 0);
+        DiagnosticLog::global().flush();
+        std::cout.flush();
+        {
+            DiagnosticLog log(pipeFds[1]);
+            reportTo(&log);
+            journalTo(journal.get());
+
+            // Cap file size at the header so the next group commit fails
+            struct rlimit saved;
+            assert(getrlimit(RLIMIT_FSIZE, &saved) == 0);
+            struct rlimit capped = saved;
+            capped.rlim_cur = sizeof(OrderLogHeader);
+            void (*previous)(int) = std::signal(SIGXFSZ, SIG_IGN);
+            assert(setrlimit(RLIMIT_FSIZE, &capped) == 0);
+            const Status failed = insert("JOURNAL_FAIL", 1, 10);
+            setrlimit(RLIMIT_FSIZE, &saved);
+            std::signal(SIGXFSZ, previous);
+            assert(failed == Status::WriteFailed);
+            assert(getSummary("JOURNAL_FAIL").totalLot == 1);
+
+            const std::uint64_t appended = journal->appended();
+            assert(addOrder("JOURNAL_FAIL", 5001, 2, 11) == Status::WriteFailed);
+            assert(cancel(5001) == Status::WriteFailed);
+            assert(remove("JOURNAL_FAIL") == Status::WriteFailed);
+            assert(journal->appended() == appended);
+            journalTo(nullptr);
+            reportTo(&DiagnosticLog::global());
+            log.flush();
+            assert(log.reported(DiagnosticKind::WriteFailed) == 4);
+        }
+        journal.reset();
+        close(pipeFds[0]);
+        close(pipeFds[1]);
+        std::remove(path.c_str());
+        return true;
+    }
 
-    // Disable copy constructor and assignment operator
-    Order(const Order& other) = delete;
-    Order& operator=(const Order& other) = delete;
+    // Test case for the exact text display() renders for a book
+    bool testDisplayFormat() {
+        const SymbolId id = intern("FORMAT");
+        insert(id, 12, 40);
+        insert(id, 3, -7);
+        insert(id, 5, 41, Side::Sell);
+        std::ostringstream out;
+        display(out);
+        const std::string text = out.str();
+        const std::string expected =
+            "FORMAT: {lotSize: 3, price: -7} {lotSize: 12, price: 40} | asks: {lotSize: 5, price: 41} \n";
+        assert(text.find(expected) != std::string::npos);
+        assert(text.back() == '\n');
+        remove(id);
 
-    // Enable move constructor and move assignment
-    Order(Order&& other) noexcept : lotSize(other.lotSize), price(other.price) {
-        other.lotSize = nullptr;  // Set other to a safe state
+        // Floating-point values print as a default ostream would
+        FormatBuffer buffer;
+        for (double value : {0.1 + 0.2, 1e-7, 123456789.0, 2.5, -0.0}) {
+            std::ostringstream stream;
+            stream << value;
+            buffer.clear();
+            buffer.appendValue(value);
+            assert(std::string(buffer.data(), buffer.size()) == stream.str());
+        }
+        return true;
     }
 
-    Order& operator=(Order&& other) noexcept {
-        if (this != &other) {
-            delete lotSize;  // Clean up existing resource
-            lotSize = other.lotSize;
-            price = other.price;
-            other.lotSize = nullptr;  // Set other to a safe state
+    // Test case for status results and rate-limited asynchronous diagnostics
+    bool testDiagnostics() {
+        const std::string path = "/tmp/chm_test_diagnostics_" + std::to_string(getpid());
+        const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        assert(fd >= 0);
+        {
+            DiagnosticLog log(fd, 4);
+            reportTo(&log);
+            assert(remove("DIAG_MISSING") == Status::NotFound);
+            assert(!getPriceRange("DIAG_MISSING"));
+            for (int i = 0; i < 100; ++i) {
+                assert(remove(kInvalidSymbol - 3) == Status::NotFound);
+            }
+            assert(insert("DIAG", 1, 10) == Status::Ok);
+            assert(getPriceRange("DIAG")->first == 10);
+            assert(remove("DIAG") == Status::Ok);
+            reportTo(&DiagnosticLog::global());
+
+            // At most two budgets pass if the events straddle a second
+            log.flush();
+            assert(log.reported(DiagnosticKind::SymbolNotFound) == 102);
+            assert(log.suppressed(DiagnosticKind::SymbolNotFound) >= 102 - 2 * 4);
+            assert(log.reported(DiagnosticKind::OrderNotFound) == 0);
+            assert(log.dropped() == 0);
         }
-        return *this;
+
+        std::string text(4096, '\0');
+        const ssize_t bytes = ::pread(fd, &text[0], text.size(), 0);
+        ::close(fd);
+        std::remove(path.c_str());
+        assert(bytes > 0);
+        text.resize(static_cast<std::size_t>(bytes));
+        assert(text.find("Error: Symbol DIAG_MISSING not found for removal.\n") == 0);
+        assert(text.find("Suppressed ") != std::string::npos);
+        assert(text.find(" symbol not found diagnostics.\n") != std::string::npos);
+        return true;
     }
 
-    // Destructor to clean up the atomic pointer
-    ~Order() {
-        delete lotSize;
+    // Test case for checkpointing, parallel load and replaying the journal tail
+    bool testCheckpoint() {
+        const std::string checkpoint = "/tmp/chm_test_checkpoint_" + std::to_string(getpid());
+        const std::string journalPath = checkpoint + ".journal";
+        std::remove(journalPath.c_str());
+        std::unique_ptr<Journal> journal = Journal::open(journalPath);
+        assert(journal != nullptr);
+        journalTo(journal.get());
+
+        const SymbolId a = intern("CKPT_A");
+        insert(a, 5, 10);
+        insert(a, 3, 12, Side::Sell);
+        assert(addOrder(a, 4001, 2, 10) == Status::Ok);
+        assert(addOrder("CKPT_B", 4002, 6, 20, Side::Sell) == Status::Ok);
+        insert("CKPT_C", 1, 1);
+        remove("CKPT_C");
+        assert(snapshot(checkpoint));
+
+        // Changes after the checkpoint live only in the journal
+        insert(a, 1, 11);
+        assert(cancel(4001) == Status::Ok);
+        insert("CKPT_C", 8, 2);
+        journalTo(nullptr);
+        journal.reset();
+
+        ConcurrentHashMap<K, V> restored(8);
+        assert(restored.load(checkpoint, 3));
+        assert(restored.getSummary("CKPT_A").depth == 2);
+        assert(restored.getTopOfBook("CKPT_A").bidLot == 7);
+        assert(!restored.getSummary("CKPT_C").live);
+        const ReplayStats stats = recoverJournal(restored, journalPath);
+        std::remove(checkpoint.c_str());
+        std::remove(journalPath.c_str());
+        assert(stats.rejected == 0 && stats.skipped > 0);
+
+        for (const char* symbol : {"CKPT_A", "CKPT_B", "CKPT_C"}) {
+            const BookSummary<V> before = getSummary(symbol);
+            const BookSummary<V> after = restored.getSummary(symbol);
+            assert(before.live == after.live && before.depth == after.depth);
+            assert(before.totalLot == after.totalLot);
+            assert(before.lowPrice == after.lowPrice && before.highPrice == after.highPrice);
+        }
+        assert(restored.getTopOfBook("CKPT_A").bidPrice == 11);
+        assert(restored.books_[restored.lookup("CKPT_A")].bids.find(10)->lotSize.load() == 5);
+        assert(restored.cancel(4002) == Status::Ok);  // Indexed orders come back with the checkpoint
+        assert(restored.cancel(4001) == Status::NotFound);
+
+        // Counts that wrap around or slices outside the file are refused
+        auto corrupt = [&checkpoint](off_t offset, std::uint64_t value) {
+            const int fd = ::open(checkpoint.c_str(), O_WRONLY);
+            assert(fd >= 0 && ::pwrite(fd, &value, sizeof(value), offset) == static_cast<ssize_t>(sizeof(value)));
+            ::close(fd);
+        };
+        ConcurrentHashMap<K, V> rejected(2);
+        assert(snapshot(checkpoint));
+        corrupt(offsetof(CheckpointHeader, levelCount), 0x1000000000000001ull);  // 16 * count wraps to 16
+        assert(!rejected.load(checkpoint));
+        assert(snapshot(checkpoint));
+        corrupt(sizeof(CheckpointHeader) + offsetof(CheckpointBook, firstLevel), 1000000);
+        assert(!rejected.load(checkpoint));
+
+        // A table too small for every book refuses the load instead of dropping books
+        ConcurrentHashMap<K, V> small(1, 2);
+        assert(snapshot(checkpoint));
+        assert(!small.load(checkpoint));
+        std::remove(checkpoint.c_str());
+
+        cancel(4002);
+        remove("CKPT_A");
+        remove("CKPT_B");
+        remove("CKPT_C");
+        return true;
     }
 };
 
-template <typename K, typename V>
-class ConcurrentHashMap {
+// Price-time crossing engine on top of a map's books. Incoming limit orders
+// match against the opposite side at the best prices first and, within a
+// price, in arrival order; any remainder rests. Each symbol is serialized by
+// its own lock, so matching on different symbols runs in parallel. Resting
+// orders are mirrored into the map through its order index, keeping its
+// aggregated levels, top of book and display in step. Only orders entered
+// through the engine are crossable. Their lots must only change through the
+// engine; an engine order cancelled or removed through the map is dropped
+// from the queue the next time it would have traded.
+template <typename K, typename V, typename Alloc>
+class MatchingEngine {
 public:
-    // Insert a new order or update an existing one
-    void insert(const K& symbol, Order<K, V>&& order) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto& orders = map_[symbol];
-        bool found = false;
+    explicit MatchingEngine(ConcurrentHashMap<K, V, Alloc>& map)
+        : map_(map), books_(new SymbolBook[map.symbolCapacity()]) {}
+
+    MatchingEngine(const MatchingEngine& other) = delete;
+    MatchingEngine& operator=(const MatchingEngine& other) = delete;
+
+    // Match an order and rest what is left; trades are appended to trades.
+    // A symbol id that was never interned, a missing id or a lot that is
+    // not positive is Rejected, and an id already resting in the map is Duplicate; neither
+    // trades. An id added to the map directly while the order is matching
+    // is the caller's error: the order then trades but does not rest.
+    SubmitResult<V> submit(SymbolId symbol, OrderId orderId, Side side, V lot, int price,
+                           std::vector<Trade<V>>& trades) {
+        if (!map_.isInterned(symbol) || orderId == kNoOrderId || !(lot > V())) {
+            Diagnostic event;
+            event.kind = DiagnosticKind::OrderRejected;
+            event.symbol = symbol;
+            event.order = orderId;
+            map_.diagnose(event);
+            return {Status::Rejected, V()};
+        }
+        if (map_.hasOrder(orderId)) {
+            map_.diagnoseOrder(DiagnosticKind::DuplicateOrder, orderId);
+            return {Status::Duplicate, V()};
+        }
+        SymbolBook& book = books_[symbol];
+        std::lock_guard<std::mutex> lock(book.mutex);
+        V remaining = side == Side::Buy
+            ? cross(book.asks, symbol, orderId, side, lot, [price](int level) { return level <= price; }, trades)
+            : cross(book.bids, symbol, orderId, side, lot, [price](int level) { return level >= price; }, trades);
+        if (remaining == V()) {
+            return {Status::Ok, V()};
+        }
+        // An order the map took but could not journal still rests
+        const Status added = map_.addOrder(symbol, orderId, remaining, price, side);
+        if (added != Status::Ok && added != Status::WriteFailed) {
+            return {added, V()};
+        }
+        if (side == Side::Buy) {
+            book.bids[price].push_back({orderId, remaining});
+        } else {
+            book.asks[price].push_back({orderId, remaining});
+        }
+        return {added, remaining};
+    }
+
+    SubmitResult<V> submit(const K& symbol, OrderId orderId, Side side, V lot, int price,
+                           std::vector<Trade<V>>& trades) {
+        const SymbolId id = map_.intern(symbol);
+        if (id == kInvalidSymbol) {
+            map_.diagnose(DiagnosticKind::SymbolTableFull, "insert", symbol);
+            return {Status::TableFull, V()};
+        }
+        return submit(id, orderId, side, lot, price, trades);
+    }
+
+    // Cancel a resting engine order; returns false if it is not resting
+    bool cancel(SymbolId symbol, OrderId orderId, Side side, int price) {
+        if (symbol >= map_.symbolCapacity()) {
+            return false;
+        }
+        SymbolBook& book = books_[symbol];
+        std::lock_guard<std::mutex> lock(book.mutex);
+        const bool found = side == Side::Buy ? unlink(book.bids, price, orderId)
+                                             : unlink(book.asks, price, orderId);
+        return found && map_.cancel(orderId) != Status::NotFound;
+    }
+
+private:
+    struct Resting {
+        OrderId id;
+        V lot;
+    };
+
+    // Queues are ordered best price first for their side
+    struct alignas(64) SymbolBook {
+        std::mutex mutex;
+        std::map<int, std::deque<Resting>, std::greater<int>> bids;
+        std::map<int, std::deque<Resting>, std::less<int>> asks;
+    };
 
-        for (auto& existingOrder : orders) {
-            if (existingOrder.price == order.price) {
-                existingOrder.lotSize->fetch_add(order.lotSize->load(std::memory_order_relaxed), std::memory_order_relaxed);
-                found = true;
-                break;
+    // Fill lot from the best levels of the opposite side while they cross
+    template <typename Levels, typename Crosses>
+    V cross(Levels& levels, SymbolId symbol, OrderId orderId, Side side, V lot, Crosses crosses,
+            std::vector<Trade<V>>& trades) {
+        while (lot != V() && !levels.empty() && crosses(levels.begin()->first)) {
+            const int price = levels.begin()->first;
+            std::deque<Resting>& queue = levels.begin()->second;
+            while (lot != V() && !queue.empty()) {
+                Resting& resting = queue.front();
+                const V fill = lot < resting.lot ? lot : resting.lot;
+                // Gone from the map: cancelled or removed there, so it cannot trade
+                if (map_.modify(resting.id, resting.lot - fill) == Status::NotFound) {
+                    queue.pop_front();
+                    continue;
+                }
+                trades.push_back({symbol, orderId, resting.id, side, price, fill});
+                lot -= fill;
+                resting.lot -= fill;
+                if (resting.lot == V()) {
+                    queue.pop_front();
+                }
+            }
+            if (queue.empty()) {
+                levels.erase(levels.begin());
             }
         }
+        return lot;
+    }
 
-        if (!found) {
-            orders.push_back(std::move(order));
+    template <typename Levels>
+    static bool unlink(Levels& levels, int price, OrderId orderId) {
+        auto level = levels.find(price);
+        if (level == levels.end()) {
+            return false;
+        }
+        std::deque<Resting>& queue = level->second;
+        for (auto it = queue.begin(); it != queue.end(); ++it) {
+            if (it->id == orderId) {
+                queue.erase(it);
+                if (queue.empty()) {
+                    levels.erase(level);
+                }
+                return true;
+            }
         }
+        return false;
     }
 
-    // Remove an order by symbol
-    void remove(const K& symbol) {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto it = map_.find(symbol);
-        if (it == map_.end()) {
-            std::cerr << "Error: Symbol " << symbol << " not found for removal." << std::endl;
-            return;  // Return early if symbol not found
+    ConcurrentHashMap<K, V, Alloc>& map_;
+    std::unique_ptr<SymbolBook[]> books_;
+};
+
+// Apply one order-log record to the book of id; false if the record is
+// malformed or the map refused it
+template <typename K, typename V, typename Alloc>
+bool applyLogRecord(ConcurrentHashMap<K, V, Alloc>& map, SymbolId id, const OrderLogRecord& record) {
+    if (!validRecord(record)) {
+        return false;
+    }
+    switch (record.action) {
+    case LogAction::Add:
+        if (record.orderId == kNoOrderId) {
+            return map.insert(id, record.lot, record.price, record.side) == Status::Ok;
         }
-        map_.erase(it);
+        return map.addOrder(id, record.orderId, record.lot, record.price, record.side) == Status::Ok;
+    case LogAction::Cancel:
+        return map.cancel(record.orderId) == Status::Ok;
+    case LogAction::Modify:
+        return map.modify(record.orderId, record.lot) == Status::Ok;
+    case LogAction::Reduce:
+        return map.reduce(id, record.price, record.lot, record.side) == Status::Ok;
+    case LogAction::Remove:
+        return map.remove(id) == Status::Ok;
+    default:
+        return false;
     }
+}
 
-    // Display all orders
-    void display() const {
-        std::lock_guard<std::mutex> lock(mutex_);
-        for (const auto& pair : map_) {
-            std::cout << pair.first << ": ";
-            for (const auto& order : pair.second) {
-                std::cout << "{lotSize: " << order.lotSize->load() << ", price: " << order.price << "} ";
+// Feed an order log into a map. With several threads each one applies the
+// records of its own subset of symbols, so every symbol still sees its
+// records in log order; all threads scan the shared mapping in place.
+template <typename K, typename V, typename Alloc>
+ReplayStats replayOrderLog(ConcurrentHashMap<K, V, Alloc>& map, const MappedOrderLog& log, std::size_t threads) {
+    threads = std::max<std::size_t>(1, threads);
+    std::vector<SymbolId> ids(log.symbolCount());
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        ids[i] = map.intern(K(log.symbol(i)));
+    }
+
+    const OrderLogRecord* records = log.records();
+    const std::size_t count = log.recordCount();
+    std::atomic<std::size_t> rejected{0};
+    auto replay = [&](std::size_t thread) {
+        std::size_t refused = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            const OrderLogRecord& record = records[i];
+            if (record.symbol >= ids.size()) {
+                refused += thread == 0;
+                continue;
             }
-            std::cout << std::endl;
+            if (record.symbol % threads != thread) {
+                continue;
+            }
+            refused += !applyLogRecord(map, ids[record.symbol], record);
         }
+        rejected.fetch_add(refused);
+    };
+
+    ReplayStats stats;
+    stats.records = count;
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (std::size_t t = 1; t < threads; ++t) {
+        workers.emplace_back(replay, t);
+    }
+    replay(0);
+    for (auto& worker : workers) {
+        worker.join();
     }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    stats.rejected = rejected.load();
+    return stats;
+}
 
-    // Get the lowest and highest price for a given symbol
-    std::pair<int, int> getPriceRange(const K& symbol) const {
-        std::lock_guard<std::mutex> lock(mutex_);
-        auto it = map_.find(symbol);
-        if (it == map_.end()) {
-            std::cerr << "Error: Symbol " << symbol << " not found for price range." << std::endl;
-            return {0, 0}; // Return {0, 0} if symbol not found
+// Rebuild a map from a journal, applying its records in order. A torn
+// record at the end, left by a crash mid-write, is ignored. Records that a
+// checkpoint loaded into the map already covers are skipped, so recovery
+// after load() replays only the journal's tail.
+template <typename K, typename V, typename Alloc>
+ReplayStats recoverJournal(ConcurrentHashMap<K, V, Alloc>& map, const std::string& path) {
+    ReplayStats stats;
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(OrderLogHeader)) {
+        std::cerr << "Error: Cannot open journal " << path << "." << std::endl;
+        if (fd >= 0) {
+            close(fd);
         }
+        return stats;
+    }
+    const std::size_t bytes = static_cast<std::size_t>(info.st_size);
+    void* base = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED || static_cast<const OrderLogHeader*>(base)->magic != kJournalMagic) {
+        std::cerr << "Error: " << path << " is not a journal." << std::endl;
+        if (base != MAP_FAILED) {
+            munmap(base, bytes);
+        }
+        return stats;
+    }
 
-        const auto& orders = it->second;
-        if (orders.empty()) {
-            return {0, 0};
+    const auto start = std::chrono::steady_clock::now();
+    const OrderLogRecord* records =
+        reinterpret_cast<const OrderLogRecord*>(static_cast<const char*>(base) + sizeof(OrderLogHeader));
+    stats.records = (bytes - sizeof(OrderLogHeader)) / sizeof(OrderLogRecord);
+    std::vector<SymbolId> ids;
+    std::unordered_map<std::uint32_t, std::string> names;  // Names still arriving
+    for (std::size_t i = 0; i < stats.records; ++i) {
+        const OrderLogRecord& record = records[i];
+        if (record.action == LogAction::Symbol) {
+            if (record.symbol >= map.symbolCapacity()) {
+                ++stats.rejected;
+                continue;
+            }
+            if (record.symbol >= ids.size()) {
+                ids.resize(record.symbol + 1, kInvalidSymbol);
+            }
+            std::string& name = names[record.symbol];
+            unpackSymbolName(name, record);
+            if (record.reserved == 0) {
+                ids[record.symbol] = map.intern(K(name));
+                names.erase(record.symbol);
+            }
+            continue;
+        }
+        const SymbolId id = record.symbol < ids.size() ? ids[record.symbol] : kInvalidSymbol;
+        if (id != kInvalidSymbol && i + 1 <= map.restoredLsn(id)) {
+            ++stats.skipped;
+        } else if (id == kInvalidSymbol || !applyLogRecord(map, id, record)) {
+            ++stats.rejected;
         }
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    munmap(base, bytes);
+    return stats;
+}
 
-        auto minMax = std::minmax_element(orders.begin(), orders.end(),
-            [](const Order<K, V>& a, const Order<K, V>& b) {
-                return a.price < b.price;
-            });
+// Write a synthetic day of order flow: adds around a drifting mid price,
+// with cancels and modifies of earlier orders mixed in
+inline bool generateOrderLog(const std::string& path, std::size_t recordCount, std::size_t symbolCount) {
+    std::vector<std::string> symbols;
+    for (std::size_t s = 0; s < symbolCount; ++s) {
+        symbols.push_back("SYM" + std::to_string(s));
+    }
+    std::vector<OrderLogRecord> records;
+    records.reserve(recordCount);
+    std::vector<std::vector<OrderLogRecord>> resting(symbolCount);
+    std::vector<int> mid(symbolCount, 10000);
+    std::uint64_t state = 0x9E3779B97F4A7C15ull;
+    auto next = [&state]() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    };
+    OrderId nextOrder = 1;
 
-        return {minMax.first->price, minMax.second->price};
+    while (records.size() < recordCount) {
+        const std::uint64_t roll = next();
+        const std::uint32_t symbol = static_cast<std::uint32_t>(roll % symbolCount);
+        std::vector<OrderLogRecord>& live = resting[symbol];
+        const unsigned kind = (roll >> 32) % 10;
+        if (kind < 2 && !live.empty()) {
+            // Cancel or modify a random resting order of the symbol
+            const std::size_t pick = (roll >> 40) % live.size();
+            OrderLogRecord record = live[pick];
+            if (kind == 0) {
+                record.action = LogAction::Cancel;
+                live[pick] = live.back();
+                live.pop_back();
+            } else {
+                record.action = LogAction::Modify;
+                record.lot = 1 + static_cast<std::int32_t>((roll >> 48) % 100);
+                live[pick].lot = record.lot;
+            }
+            records.push_back(record);
+            continue;
+        }
+        mid[symbol] += static_cast<int>((roll >> 36) % 3) - 1;
+        const Side side = (roll >> 38) & 1 ? Side::Buy : Side::Sell;
+        const int offset = 1 + static_cast<int>((roll >> 40) % 50);
+        OrderLogRecord record{};
+        record.orderId = nextOrder++;
+        record.symbol = symbol;
+        record.price = side == Side::Buy ? mid[symbol] - offset : mid[symbol] + offset;
+        record.lot = 1 + static_cast<std::int32_t>((roll >> 48) % 100);
+        record.action = LogAction::Add;
+        record.side = side;
+        records.push_back(record);
+        live.push_back(record);
     }
+    return writeOrderLog(path, symbols, records);
+}
 
-    // Test functions for validation
-    void test() {
-        assert(testInsert());
-        assert(testRemove());
-        assert(testDisplay());
-        assert(testPriceRange());
+// Shape of one benchmark case
+struct BenchCase {
+    std::size_t shards;
+    std::size_t threads;
+    std::size_t symbols;
+    std::size_t depth;
+};
+
+// Throughput and latency distribution of one benchmark case. Latencies are
+// per-operation means over samples of opsPerSample operations each, so with
+// more than one operation per sample they understate the per-operation tail.
+struct BenchResult {
+    std::string name;
+    BenchCase config;
+    std::size_t operations;
+    std::size_t opsPerSample;
+    double opsPerSecond;
+    double sampleP50Ns;
+    double sampleP90Ns;
+    double sampleP99Ns;
+    double sampleMaxNs;
+};
+
+// Stream buffer that accepts and discards everything, so display() can be
+// timed including formatting but without terminal I/O
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override {
+        return c;
     }
 
-private:
-    std::unordered_map<K, std::vector<Order<K, V>>> map_;
-    mutable std::mutex mutex_;
+    std::streamsize xsputn(const char*, std::streamsize count) override {
+        return count;
+    }
+};
 
-    // Test case for inserting orders
-    bool testInsert() {
-        insert("TEST", Order<K, V>(10, 2));
-        {
-            const auto& orders = map_.at("TEST");
-            assert(orders.size() == 1);
-            assert(orders[0].lotSize->load() == 10);
-            assert(orders[0].price == 2);
+// Time fn() in nanoseconds
+template <typename F>
+double timeNs(F&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+// Run sample(thread, index) on config.threads threads released together.
+// Each call performs opsPerSample operations and returns the nanoseconds its
+// timed part took; batching keeps clock reads out of sub-microsecond
+// operations. The first warmupSamples calls per thread are discarded, and
+// percentiles are taken over the mean operation latency of each remaining
+// sample, not over individual operations.
+template <typename Sample>
+BenchResult runBenchmark(const std::string& name, const BenchCase& config, std::size_t opsPerSample,
+                         std::size_t warmupSamples, std::size_t samples, Sample sample) {
+    std::vector<std::vector<double>> latencies(config.threads);
+    std::vector<double> busyNs(config.threads, 0.0);
+    std::atomic<std::size_t> ready{0};
+    std::vector<std::thread> threads;
+
+    for (std::size_t t = 0; t < config.threads; ++t) {
+        threads.emplace_back([&, t]() {
+            ready.fetch_add(1);
+            while (ready.load() < config.threads) {
+                std::this_thread::yield();
+            }
+            for (std::size_t i = 0; i < warmupSamples; ++i) {
+                sample(t, i);
+            }
+            latencies[t].reserve(samples);
+            for (std::size_t i = 0; i < samples; ++i) {
+                const double ns = sample(t, warmupSamples + i);
+                busyNs[t] += ns;
+                latencies[t].push_back(ns / opsPerSample);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::vector<double> all;
+    for (const auto& perThread : latencies) {
+        all.insert(all.end(), perThread.begin(), perThread.end());
+    }
+    std::sort(all.begin(), all.end());
+    auto percentile = [&all](double q) {
+        return all[std::min(all.size() - 1, static_cast<std::size_t>(q * all.size()))];
+    };
+
+    BenchResult result;
+    result.name = name;
+    result.config = config;
+    result.operations = opsPerSample * samples * config.threads;
+    result.opsPerSample = opsPerSample;
+    // Threads run concurrently, so the slowest one bounds the measured phase
+    result.opsPerSecond = result.operations / (*std::max_element(busyNs.begin(), busyNs.end()) * 1e-9);
+    result.sampleP50Ns = percentile(0.50);
+    result.sampleP90Ns = percentile(0.90);
+    result.sampleP99Ns = percentile(0.99);
+    result.sampleMaxNs = all.back();
+    return result;
+}
+
+// Build a map with config.symbols interned symbols of config.depth levels each
+std::unique_ptr<ConcurrentHashMap<std::string, int>> makeBenchMap(const BenchCase& config,
+                                                                 std::vector<std::string>& symbols,
+                                                                 std::vector<SymbolId>& ids) {
+    auto map = std::make_unique<ConcurrentHashMap<std::string, int>>(config.shards);
+    symbols.clear();
+    ids.clear();
+    for (std::size_t s = 0; s < config.symbols; ++s) {
+        symbols.push_back("SYM" + std::to_string(s));
+        ids.push_back(map->intern(symbols.back()));
+        for (std::size_t level = 0; level < config.depth; ++level) {
+            map->insert(ids.back(), 1, static_cast<int>(level));
         }
-        insert("TEST", Order<K, V>(20, 2));
-        {
-            const auto& orders = map_.at("TEST");
-            assert(orders.size() == 1);
-            assert(orders[0].lotSize->load() == 30);
-            assert(orders[0].price == 2);
+    }
+    return map;
+}
+
+// Every thread works on its own slice of the symbols, as feed threads would
+std::size_t benchSymbol(const BenchCase& config, std::size_t thread, std::size_t n) {
+    const std::size_t slice = std::max<std::size_t>(1, config.symbols / config.threads);
+    return (thread * slice + n % slice) % config.symbols;
+}
+
+std::vector<BenchResult> runBenchmarkSuite() {
+    const std::size_t opsPerSample = 1000;
+    const std::size_t warmup = 5;
+    const std::size_t samples = 200;
+    std::vector<BenchResult> results;
+    std::vector<std::string> symbols;
+    std::vector<SymbolId> ids;
+
+    for (std::size_t shards : {1, 16}) {
+        for (std::size_t threads : {1, 2, 4, 8, 16}) {
+            for (std::size_t symbolCount : {10, 5000}) {
+                for (std::size_t depth : {1, 50, 500}) {
+                    const BenchCase config{shards, threads, symbolCount, depth};
+                    auto map = makeBenchMap(config, symbols, ids);
+
+                    // New orders keyed by symbol name, landing on existing levels
+                    results.push_back(runBenchmark("insert", config, opsPerSample, warmup, samples,
+                        [&](std::size_t t, std::size_t i) {
+                            return timeNs([&]() {
+                                for (std::size_t n = 0; n < opsPerSample; ++n) {
+                                    const std::size_t op = i * opsPerSample + n;
+                                    map->insert(symbols[benchSymbol(config, t, op)], 1,
+                                                static_cast<int>((op * 7919) % depth));
+                                }
+                            });
+                        }));
+
+                    // Aggregation into existing levels through interned ids
+                    results.push_back(runBenchmark("aggregate", config, opsPerSample, warmup, samples,
+                        [&](std::size_t t, std::size_t i) {
+                            return timeNs([&]() {
+                                for (std::size_t n = 0; n < opsPerSample; ++n) {
+                                    const std::size_t op = i * opsPerSample + n;
+                                    map->insert(ids[benchSymbol(config, t, op)], 1,
+                                                static_cast<int>((op * 7919) % depth));
+                                }
+                            });
+                        }));
+
+                    // The same updates delivered as insertBatch packets
+                    results.push_back(runBenchmark("insertBatch", config, opsPerSample, warmup, samples,
+                        [&](std::size_t t, std::size_t i) {
+                            std::vector<OrderUpdate<int>> packet(opsPerSample);
+                            for (std::size_t n = 0; n < opsPerSample; ++n) {
+                                const std::size_t op = i * opsPerSample + n;
+                                packet[n] = {ids[benchSymbol(config, t, op)], 1,
+                                             static_cast<int>((op * 7919) % depth)};
+                            }
+                            return timeNs([&]() {
+                                map->insertBatch(packet);
+                            });
+                        }));
+
+                    results.push_back(runBenchmark("getPriceRange", config, opsPerSample, warmup, samples,
+                        [&](std::size_t t, std::size_t i) {
+                            int sink = 0;
+                            const double ns = timeNs([&]() {
+                                for (std::size_t n = 0; n < opsPerSample; ++n) {
+                                    sink += map->getPriceRange(ids[benchSymbol(config, t, i * opsPerSample + n)])->second;
+                                }
+                            });
+                            volatile int keep = sink;
+                            (void)keep;
+                            return ns;
+                        }));
+                    results.push_back(runBenchmark("getTopOfBook", config, opsPerSample, warmup, samples,
+                        [&](std::size_t t, std::size_t i) {
+                            int sink = 0;
+                            const double ns = timeNs([&]() {
+                                for (std::size_t n = 0; n < opsPerSample; ++n) {
+                                    sink += map->getTopOfBook(ids[benchSymbol(config, t, i * opsPerSample + n)]).bidPrice;
+                                }
+                            });
+                            volatile int keep = sink;
+                            (void)keep;
+                            return ns;
+                        }));
+
+                    // Removing a symbol's whole book; the refill is not timed. Each
+                    // thread needs a symbol of its own to remove.
+                    if (threads <= symbolCount) {
+                        results.push_back(runBenchmark("remove", config, 1, 1, 20,
+                            [&](std::size_t t, std::size_t) {
+                                const SymbolId id = ids[benchSymbol(config, t, 0)];
+                                const double ns = timeNs([&]() {
+                                    map->remove(id);
+                                });
+                                for (std::size_t level = 0; level < depth; ++level) {
+                                    map->insert(id, 1, static_cast<int>(level));
+                                }
+                                return ns;
+                            }));
+                    }
+
+                    // Full dumps run single threaded; one operation is one dump
+                    if (threads == 1) {
+                        NullBuffer nullBuffer;
+                        std::ostream nullStream(&nullBuffer);
+                        results.push_back(runBenchmark("display", config, 1, 2, 20,
+                            [&](std::size_t, std::size_t) {
+                                return timeNs([&]() {
+                                    map->display(nullStream);
+                                });
+                            }));
+                    }
+                }
+            }
         }
-        return true;
     }
 
-    // Test case for removing orders
-    bool testRemove() {
-        insert("TEST", Order<K, V>(10, 2));
-        remove("TEST");
+    // Full dump of 5000 symbols x 50 levels rendered and written to /dev/null
+    {
+        const BenchCase config{16, 1, 5000, 50};
+        auto map = makeBenchMap(config, symbols, ids);
+        const int devNull = ::open("/dev/null", O_WRONLY);
+        if (devNull >= 0) {
+            results.push_back(runBenchmark("display_dump", config, 1, 2, 20,
+                [&](std::size_t, std::size_t) {
+                    return timeNs([&]() {
+                        map->display(devNull);
+                    });
+                }));
+            close(devNull);
+        }
+    }
+
+    // Producer-side cost of routing inserts to shard-owning cores, against the
+    // locked path above; the actors drain and apply concurrently
+    for (std::size_t threads : {1, 2, 4, 8}) {
+        const BenchCase config{16, threads, 5000, 50};
+        auto map = makeBenchMap(config, symbols, ids);
+        ShardActors<std::string, int> actors(*map, 4, threads);
+        results.push_back(runBenchmark("actor_insert", config, opsPerSample, warmup, samples,
+            [&](std::size_t t, std::size_t i) {
+                return timeNs([&]() {
+                    for (std::size_t n = 0; n < opsPerSample; ++n) {
+                        const std::size_t op = i * opsPerSample + n;
+                        actors.insert(t, ids[benchSymbol(config, t, op)], 1, static_cast<int>((op * 7919) % 50));
+                    }
+                });
+            }));
+    }
+
+    // Producer-side cost of enqueueing into the MPSC ingress ring
+    for (std::size_t threads : {1, 2, 4, 8}) {
+        const BenchCase config{16, threads, 5000, 50};
+        auto map = makeBenchMap(config, symbols, ids);
+        IngressQueue<std::string, int> ingress(*map);
+        results.push_back(runBenchmark("ingress_insert", config, opsPerSample, warmup, samples,
+            [&](std::size_t t, std::size_t i) {
+                return timeNs([&]() {
+                    for (std::size_t n = 0; n < opsPerSample; ++n) {
+                        const std::size_t op = i * opsPerSample + n;
+                        ingress.insert(ids[benchSymbol(config, t, op)], 1, static_cast<int>((op * 7919) % 50));
+                    }
+                });
+            }));
+    }
+
+    // Aggregation into tick-indexed books against the tree rows above
+    for (std::size_t depth : {50, 500}) {
+        const BenchCase config{16, 1, 5000, depth};
+        auto map = std::make_unique<ConcurrentHashMap<std::string, int>>(config.shards);
+        ids.clear();
+        for (std::size_t s = 0; s < config.symbols; ++s) {
+            ids.push_back(map->intern("SYM" + std::to_string(s)));
+            map->useTickLadder(ids.back(), 0, 1, 1024);
+            for (std::size_t level = 0; level < depth; ++level) {
+                map->insert(ids.back(), 1, static_cast<int>(level));
+            }
+        }
+        results.push_back(runBenchmark("aggregate_tick", config, opsPerSample, warmup, samples,
+            [&](std::size_t t, std::size_t i) {
+                return timeNs([&]() {
+                    for (std::size_t n = 0; n < opsPerSample; ++n) {
+                        const std::size_t op = i * opsPerSample + n;
+                        map->insert(ids[benchSymbol(config, t, op)], 1, static_cast<int>((op * 7919) % depth));
+                    }
+                });
+            }));
+    }
+
+    // Level churn (open many levels, then drop the book) with tree nodes from
+    // the global heap versus a slab arena
+    {
+        const BenchCase config{16, 1, 100, 500};
+        auto churn = [&](auto& map, const std::string& name) {
+            std::vector<SymbolId> churnIds;
+            for (std::size_t s = 0; s < config.symbols; ++s) {
+                churnIds.push_back(map.intern("SYM" + std::to_string(s)));
+            }
+            results.push_back(runBenchmark(name, config, config.depth + 1, 5, 200,
+                [&](std::size_t, std::size_t i) {
+                    const SymbolId id = churnIds[i % churnIds.size()];
+                    return timeNs([&]() {
+                        for (std::size_t level = 0; level < config.depth; ++level) {
+                            map.insert(id, 1, static_cast<int>(level));
+                        }
+                        map.remove(id);
+                    });
+                }));
+        };
+        ConcurrentHashMap<std::string, int> heapMap(config.shards);
+        churn(heapMap, "level_churn_heap");
+        SlabArena arena;
+        ConcurrentHashMap<std::string, int, ArenaAllocator<char>> arenaMap(
+            config.shards, 8192, ArenaAllocator<char>(arena));
+        churn(arenaMap, "level_churn_arena");
+    }
+
+    // Crossing engine: every thread trades its own symbols, alternating
+    // resting sells with buys that take them out
+    for (std::size_t threads : {1, 4}) {
+        const BenchCase config{16, threads, 5000, 1};
+        auto map = makeBenchMap(config, symbols, ids);
+        MatchingEngine<std::string, int> engine(*map);
+        std::vector<OrderId> nextOrder(threads);
+        for (std::size_t t = 0; t < threads; ++t) {
+            nextOrder[t] = (static_cast<OrderId>(t) << 40) + 1;
+        }
+        results.push_back(runBenchmark("match_orders", config, opsPerSample, warmup, samples,
+            [&](std::size_t t, std::size_t i) {
+                static thread_local std::vector<Trade<int>> trades;
+                return timeNs([&]() {
+                    for (std::size_t n = 0; n < opsPerSample; ++n) {
+                        const std::size_t op = i * opsPerSample + n;
+                        const SymbolId id = ids[benchSymbol(config, t, op / 2)];
+                        const Side side = op % 2 == 0 ? Side::Sell : Side::Buy;
+                        trades.clear();
+                        engine.submit(id, nextOrder[t]++, side, 1, 100, trades);
+                    }
+                });
+            }));
+    }
+
+    // Inserts with every level change also published to a shared-memory ring
+    for (std::size_t threads : {1, 4}) {
+        const BenchCase config{16, threads, 5000, 50};
+        auto map = makeBenchMap(config, symbols, ids);
+        const std::string ringName = "/chm_bench_deltas_" + std::to_string(getpid());
+        std::unique_ptr<L2DeltaRing> ring = L2DeltaRing::create(ringName);
+        L2DeltaRing::remove(ringName);
+        if (ring == nullptr) {
+            continue;
+        }
+        map->publishDeltas(ring.get());
+        results.push_back(runBenchmark("insert_publish", config, opsPerSample, warmup, samples,
+            [&](std::size_t t, std::size_t i) {
+                return timeNs([&]() {
+                    for (std::size_t n = 0; n < opsPerSample; ++n) {
+                        const std::size_t op = i * opsPerSample + n;
+                        map->insert(ids[benchSymbol(config, t, op)], 1, static_cast<int>(op % config.depth));
+                    }
+                });
+            }));
+        map->publishDeltas(nullptr);
+    }
+
+    // Durable inserts through the journal's group commit, one at a time and
+    // as packets that share a sync
+    for (std::size_t threads : {1, 4}) {
+        const BenchCase config{16, threads, 5000, 50};
+        auto map = makeBenchMap(config, symbols, ids);
+        const std::string path = "/tmp/chm_bench_journal_" + std::to_string(getpid());
+        std::remove(path.c_str());
+        std::unique_ptr<Journal> journal = Journal::open(path);
+        if (journal == nullptr) {
+            continue;
+        }
+        map->journalTo(journal.get());
+        const std::size_t opsPerJournalSample = 100;
+        results.push_back(runBenchmark("insert_journaled", config, opsPerJournalSample, 2, 20,
+            [&](std::size_t t, std::size_t i) {
+                return timeNs([&]() {
+                    for (std::size_t n = 0; n < opsPerJournalSample; ++n) {
+                        const std::size_t op = i * opsPerJournalSample + n;
+                        map->insert(ids[benchSymbol(config, t, op)], 1, static_cast<int>(op % config.depth));
+                    }
+                });
+            }));
+        results.push_back(runBenchmark("insertBatch_journaled", config, opsPerSample, 2, 20,
+            [&](std::size_t t, std::size_t i) {
+                static thread_local std::vector<OrderUpdate<int>> packet;
+                packet.resize(opsPerSample);
+                for (std::size_t n = 0; n < opsPerSample; ++n) {
+                    const std::size_t op = i * opsPerSample + n;
+                    packet[n] = {ids[benchSymbol(config, t, op)], 1, static_cast<int>(op % config.depth)};
+                }
+                return timeNs([&]() {
+                    map->insertBatch(packet);
+                });
+            }));
+        map->journalTo(nullptr);
+        journal.reset();
+        std::remove(path.c_str());
+    }
+
+    // Open a level and reduce it away again, recycling its node each time
+    {
+        const BenchCase config{16, 1, 5000, 50};
+        auto map = makeBenchMap(config, symbols, ids);
+        results.push_back(runBenchmark("level_open_reduce", config, opsPerSample, warmup, samples,
+            [&](std::size_t t, std::size_t i) {
+                return timeNs([&]() {
+                    for (std::size_t n = 0; n < opsPerSample; ++n) {
+                        const std::size_t op = i * opsPerSample + n;
+                        const SymbolId id = ids[benchSymbol(config, t, op)];
+                        const int price = static_cast<int>(config.depth + op % config.depth);
+                        map->insert(id, 1, price);
+                        map->reduce(id, price, 1);
+                    }
+                });
+            }));
+    }
+
+    // Individually identified orders: add then cancel each through the index
+    {
+        const BenchCase config{16, 1, 5000, 50};
+        auto map = makeBenchMap(config, symbols, ids);
+        OrderId nextOrder = 1;
+        results.push_back(runBenchmark("order_add_cancel", config, opsPerSample, warmup, samples,
+            [&](std::size_t t, std::size_t i) {
+                const OrderId first = nextOrder;
+                nextOrder += opsPerSample;
+                return timeNs([&]() {
+                    for (std::size_t n = 0; n < opsPerSample; ++n) {
+                        const std::size_t op = i * opsPerSample + n;
+                        map->addOrder(ids[benchSymbol(config, t, op)], first + n, 1,
+                                      static_cast<int>(op % config.depth));
+                    }
+                    for (std::size_t n = 0; n < opsPerSample; ++n) {
+                        map->cancel(first + n);
+                    }
+                });
+            }));
+    }
+
+    // A bad feed: removes and range queries for unknown symbols, reported
+    // through a rate-limited log so failures cost no write on the caller
+    for (std::size_t threads : {1, 4}) {
+        const BenchCase config{16, threads, 5000, 1};
+        auto map = makeBenchMap(config, symbols, ids);
+        const int devNull = ::open("/dev/null", O_WRONLY);
         {
-            const std::lock_guard<std::mutex> lock(mutex_);
-            assert(map_.find("TEST") == map_.end());
+            DiagnosticLog log(devNull);
+            map->reportTo(&log);
+            results.push_back(runBenchmark("missing_symbol", config, opsPerSample, warmup, samples,
+                [&](std::size_t, std::size_t) {
+                    int sink = 0;
+                    const double ns = timeNs([&]() {
+                        for (std::size_t n = 0; n < opsPerSample; ++n) {
+                            sink += map->remove("MISSING") == Status::NotFound;
+                            sink += map->getPriceRange("MISSING").has_value();
+                        }
+                    });
+                    volatile int keep = sink;
+                    (void)keep;
+                    return ns;
+                }));
+            map->reportTo(nullptr);
         }
-        return true;
+        ::close(devNull);
     }
 
-    // Test case for displaying orders
-    bool testDisplay() const {
-        insert("TEST", Order<K, V>(10, 2));
-        display();  // This should not assert but display output
-        return true;
+    // Dispatch cost of running each insert through std::async versus the pool
+    for (std::size_t threads : {1, 4}) {
+        const BenchCase config{16, threads, 5000, 1};
+        auto map = makeBenchMap(config, symbols, ids);
+        WorkStealingPool pool;
+        const std::size_t opsPerDispatchSample = 100;
+
+        results.push_back(runBenchmark("std_async_insert", config, opsPerDispatchSample, 2, 50,
+            [&](std::size_t t, std::size_t i) {
+                return timeNs([&]() {
+                    std::vector<std::future<void>> futures;
+                    for (std::size_t n = 0; n < opsPerDispatchSample; ++n) {
+                        const std::string& symbol = symbols[benchSymbol(config, t, i * opsPerDispatchSample + n)];
+                        futures.push_back(std::async(std::launch::async, [&map, &symbol]() {
+                            map->insert(symbol, 1, 0);
+                        }));
+                    }
+                    for (auto& future : futures) {
+                        future.get();
+                    }
+                });
+            }));
+
+        results.push_back(runBenchmark("pool_insert", config, opsPerDispatchSample, 2, 50,
+            [&](std::size_t t, std::size_t i) {
+                return timeNs([&]() {
+                    std::vector<std::future<void>> futures;
+                    for (std::size_t n = 0; n < opsPerDispatchSample; ++n) {
+                        const std::string& symbol = symbols[benchSymbol(config, t, i * opsPerDispatchSample + n)];
+                        futures.push_back(map->insertAsync(pool, symbol, 1, 0));
+                    }
+                    for (auto& future : futures) {
+                        future.get();
+                    }
+                });
+            }));
     }
+    return results;
+}
 
-    // Test case for price range
-    bool testPriceRange() const {
-        insert("TEST", Order<K, V>(10, 2));
-        insert("TEST", Order<K, V>(20, 5));
-        insert("TEST", Order<K, V>(30, 1));
-        auto range = getPriceRange("TEST");
-        assert(range.first == 1);
-        assert(range.second == 5);
-        return true;
+void printBenchmarkCsv(const std::vector<BenchResult>& results, std::ostream& out) {
+    out << "name,shards,threads,symbols,depth,operations,ops_per_sample,ops_per_sec,"
+        << "sample_p50_ns,sample_p90_ns,sample_p99_ns,sample_max_ns\n";
+    for (const auto& r : results) {
+        out << r.name << ',' << r.config.shards << ',' << r.config.threads << ',' << r.config.symbols << ','
+            << r.config.depth << ',' << r.operations << ',' << r.opsPerSample << ',' << r.opsPerSecond << ','
+            << r.sampleP50Ns << ',' << r.sampleP90Ns << ',' << r.sampleP99Ns << ',' << r.sampleMaxNs << '\n';
     }
-};
+}
+
+void printBenchmarkJson(const std::vector<BenchResult>& results, std::ostream& out) {
+    out << "[\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const auto& r = results[i];
+        out << "  {\"name\": \"" << r.name << "\", \"shards\": " << r.config.shards
+            << ", \"threads\": " << r.config.threads << ", \"symbols\": " << r.config.symbols
+            << ", \"depth\": " << r.config.depth << ", \"operations\": " << r.operations
+            << ", \"ops_per_sample\": " << r.opsPerSample << ", \"ops_per_sec\": " << r.opsPerSecond
+            << ", \"sample_p50_ns\": " << r.sampleP50Ns << ", \"sample_p90_ns\": " << r.sampleP90Ns
+            << ", \"sample_p99_ns\": " << r.sampleP99Ns << ", \"sample_max_ns\": " << r.sampleMaxNs
+            << (i + 1 < results.size() ? "},\n" : "}\n");
+    }
+    out << "]\n";
+}
 
-int main() {
+// Demonstrate the map on a handful of symbols and run its self-tests
+// With a ring name, the demo's book changes are also published to a shared
+// memory delta ring of that name for a --consume process to follow
+int runDemo(const std::string& publishName) {
     ConcurrentHashMap<std::string, int> concurrentMap;
+    WorkStealingPool pool;
+
+    std::unique_ptr<L2DeltaRing> ring;
+    if (!publishName.empty()) {
+        ring = L2DeltaRing::create(publishName);
+        if (ring == nullptr) {
+            return 1;
+        }
+        concurrentMap.publishDeltas(ring.get());
+    }
 
     // Sample symbols
     std::vector<std::string> symbols = {
@@ -184,74 +6013,168 @@ int main() {
 
     // Insert initial orders asynchronously
     std::vector<std::future<void>> futures;
-    auto start = std::chrono::high_resolution_clock::now();
     for (const auto& symbol : symbols) {
-        futures.push_back(std::async(std::launch::async, [&concurrentMap, symbol]() {
-            concurrentMap.insert(symbol, Order<std::string, int>(10, 2));
-        }));
+        futures.push_back(concurrentMap.insertAsync(pool, symbol, 10, 2));
     }
     for (auto& future : futures) {
         future.get();  // Ensure all insertions are completed
     }
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> elapsed = end - start;
-    std::cout << "Time taken for initial inserts: " << elapsed.count() << " seconds\n";
 
     // Test adding to existing order and adding new order asynchronously
-    start = std::chrono::high_resolution_clock::now();
-    auto future1 = std::async(std::launch::async, [&concurrentMap]() {
-        concurrentMap.insert("NESTLEIND", Order<std::string, int>(20, 2)); 
-    });
-    auto future2 = std::async(std::launch::async, [&concurrentMap]() {
-        concurrentMap.insert("HDFCBANK", Order<std::string, int>(15, 4));  
-    });
+    auto future1 = concurrentMap.insertAsync(pool, "NESTLEIND", 20, 2);
+    auto future2 = concurrentMap.insertAsync(pool, "HDFCBANK", 15, 4);
     future1.get();
     future2.get();
-    end = std::chrono::high_resolution_clock::now();
-    elapsed = end - start;
-    std::cout << "Time taken for additional inserts: " << elapsed.count() << " seconds\n";
 
     // Display current orders
-    start = std::chrono::high_resolution_clock::now();
     concurrentMap.display();
-    end = std::chrono::high_resolution_clock::now();
-    elapsed = end - start;
-    std::cout << "Time taken for display: " << elapsed.count() << " seconds\n";
 
     // Remove an order asynchronously
-    start = std::chrono::high_resolution_clock::now();
-    auto future3 = std::async(std::launch::async, [&concurrentMap]() {
-        concurrentMap.remove("NESTLEIND");
-    });
-    future3.get();
-    end = std::chrono::high_resolution_clock::now();
-    elapsed = end - start;
-    std::cout << "Time taken for removal: " << elapsed.count() << " seconds\n";
+    concurrentMap.removeAsync(pool, "NESTLEIND").get();
 
     // Display after removal
-    start = std::chrono::high_resolution_clock::now();
     concurrentMap.display();
-    end = std::chrono::high_resolution_clock::now();
-    elapsed = end - start;
-    std::cout << "Time taken for display after removal: " << elapsed.count() << " seconds\n";
 
     // Get price range asynchronously
-    start = std::chrono::high_resolution_clock::now();
-    auto future4 = std::async(std::launch::async, [&concurrentMap]() {
-        auto range = concurrentMap.getPriceRange("HDFCBANK");
-        std::cout << "Price range for HDFCBANK: {" << range.first << ", " << range.second << "}\n";
-    });
-    future4.get();
-    end = std::chrono::high_resolution_clock::now();
-    elapsed = end - start;
-    std::cout << "Time taken for getting price range: " << elapsed.count() << " seconds\n";
+    auto range = concurrentMap.getPriceRangeAsync(pool, "HDFCBANK").get();
+    if (range) {
+        std::cout << "Price range for HDFCBANK: {" << range->first << ", " << range->second << "}\n";
+    }
 
     // Run test cases
-    start = std::chrono::high_resolution_clock::now();
+    concurrentMap.publishDeltas(nullptr);
+    // The tests are asserts, so an NDEBUG build compiles them out
+#ifndef NDEBUG
     concurrentMap.test();
-    end = std::chrono::high_resolution_clock::now();
-    elapsed = end - start;
-    std::cout << "Time taken for tests: " << elapsed.count() << " seconds\n";
+    std::cout << "All tests passed\n";
+#else
+    std::cout << "Tests skipped (built with NDEBUG)\n";
+#endif
+    return 0;
+}
+
+// Follow a delta ring until it has been quiet for a second, then print the
+// books rebuilt from it. Starts from the oldest record still in the ring.
+int runConsumer(const std::string& name) {
+    std::unique_ptr<L2DeltaRing> ring = L2DeltaRing::open(name);
+    if (ring == nullptr) {
+        return 1;
+    }
+    L2Replica replica;
+    L2Delta delta;
+    const std::uint64_t published = ring->published();
+    std::uint64_t position = published > ring->capacity() ? published - ring->capacity() : 0;
+    auto lastRecord = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - lastRecord < std::chrono::seconds(1)) {
+        switch (ring->read(position, delta)) {
+        case L2DeltaRing::ReadStatus::Ok:
+            replica.apply(delta);
+            ++position;
+            lastRecord = std::chrono::steady_clock::now();
+            break;
+        case L2DeltaRing::ReadStatus::Overrun:
+            std::cerr << "Error: Fell behind at record " << position + 1 << "; book may be incomplete." << std::endl;
+            position = ring->published() - ring->capacity();
+            break;
+        case L2DeltaRing::ReadStatus::Empty:
+            std::this_thread::yield();
+            break;
+        }
+    }
+    std::cout << "Applied " << position << " deltas" << std::endl;
+    replica.print(std::cout);
+    return 0;
+}
+
+// Replay an order log into a fresh map and report the sustained rate. With a
+// checkpoint path, also time writing the replayed books there and loading
+// them back into another map, as a warm restart would.
+int runReplay(const std::string& path, std::size_t threads, const std::string& checkpoint) {
+    std::unique_ptr<MappedOrderLog> log = MappedOrderLog::open(path);
+    if (log == nullptr) {
+        return 1;
+    }
+    ConcurrentHashMap<std::string, int> map(64, std::max<std::size_t>(8192, log->symbolCount()));
+    const ReplayStats stats = replayOrderLog(map, *log, threads);
+    std::cout << "Replayed " << stats.records << " records (" << stats.rejected << " rejected) on "
+              << threads << " threads in " << stats.seconds << " s: "
+              << static_cast<std::uint64_t>(stats.ordersPerSecond()) << " orders/s" << std::endl;
+    if (checkpoint.empty()) {
+        return 0;
+    }
+
+    bool ok = true;
+    const double snapshotNs = timeNs([&]() {
+        ok = map.snapshot(checkpoint);
+    });
+    ConcurrentHashMap<std::string, int> restarted(64, std::max<std::size_t>(8192, log->symbolCount()));
+    const double loadNs = timeNs([&]() {
+        ok = ok && restarted.load(checkpoint, threads);
+    });
+    if (!ok) {
+        return 1;
+    }
+    std::cout << "Checkpoint written in " << snapshotNs * 1e-6 << " ms, loaded on " << threads
+              << " threads in " << loadNs * 1e-6 << " ms" << std::endl;
+    return 0;
+}
+
+// Usage: Source [--bench [--csv | --json]] [--publish NAME | --consume NAME]
+//               [--generate-log PATH COUNT | --replay PATH [--threads N] [--checkpoint PATH]]
+int main(int argc, char* argv[]) {
+    bool bench = false;
+    std::string format = "csv";
+    std::string publishName;
+    std::string consumeName;
+    std::string generatePath;
+    std::size_t generateCount = 0;
+    std::string replayPath;
+    std::size_t replayThreads = 1;
+    std::string checkpointPath;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--bench") {
+            bench = true;
+        } else if (arg == "--csv" || arg == "--json") {
+            format = arg.substr(2);
+        } else if ((arg == "--publish" || arg == "--consume") && i + 1 < argc) {
+            (arg == "--publish" ? publishName : consumeName) = argv[++i];
+        } else if (arg == "--generate-log" && i + 2 < argc) {
+            generatePath = argv[++i];
+            generateCount = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--replay" && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (arg == "--threads" && i + 1 < argc) {
+            replayThreads = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            checkpointPath = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--bench [--csv | --json]] [--publish NAME | --consume NAME]"
+                      << " [--generate-log PATH COUNT | --replay PATH [--threads N] [--checkpoint PATH]]"
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    if (!consumeName.empty()) {
+        return runConsumer(consumeName);
+    }
+    if (!generatePath.empty()) {
+        return generateOrderLog(generatePath, generateCount, 500) ? 0 : 1;
+    }
+    if (!replayPath.empty()) {
+        return runReplay(replayPath, replayThreads, checkpointPath);
+    }
+    if (!bench) {
+        return runDemo(publishName);
+    }
 
+    const std::vector<BenchResult> results = runBenchmarkSuite();
+    if (format == "json") {
+        printBenchmarkJson(results, std::cout);
+    } else {
+        printBenchmarkCsv(results, std::cout);
+    }
     return 0;
 }